@@ -6,223 +6,998 @@
 #include <stdio.h>
 #include <string.h>
 #include "boardio.h"
-#include <time.h>
+#include "movegen.h"
+#include "eval.h"
+#include "timer.h"
+#include <sched.h>
 
-#define ALL_BLACK     0xAA55AA55AA55AA55
-#define ALL_WHITE     0x55AA55AA55AA55AA
 #define DEPTH 5
-#define EDGE_PIECES   0x1800008181000018
-#define CORNER_PIECES 0x8100000000000081
-#define MAX_TIME 20
-
-#define INT_MAX 127
-#define INT_MIN -128
+#define CLOCK_CHECK_NODES 1024 // power of two, nodes searched between looks at the clock
 
 bool shiftValid(U64 jump, U8 shift, bool max);
-void addMovablePieces(StateNode* node, U8* piecesList, U64* colorSpots, U64 startSpot, char colorPiece);
 void createChild(StateNodePool* pool, StateNode* parent, U64 newDirection, U64 startSpot, U64 allPlayer);
+void createChildFromMove(StateNodePool* pool, StateNode* parent, Move move);
 void generateChildrenDirections(StateNodePool* pool, StateNode* parent, U8* piecesList, U64 startSpot, char playerKind, U64* statesCreated);
+static void agentMoveAlphaBeta(Agent *agent, BitBoard* board, SearchResult *out);
+
+
+// The exact score of a position the tablebase knows, counted from the root
+// like any other win or loss
+static inline I32 tablebaseScore(TablebaseResult result, I32 ply) {
+  return (result.win) ? SCORE_WIN - ply - result.plies : ply + result.plies - SCORE_WIN;
+}
+
+
+// Also fills in mobility, so a leaf can be scored with TreeNodeCalcCost()
+// without looking at the board again. A position in the tablebase is over
+// as far as the search cares, mobility is left alone then.
+bool isOver(TreeNode* node, PlayerKind player, I32 ply, Mobility *mobility) {
+  BitBoard board = { .whole = node->board };
+  TablebaseResult tbResult;
+  if (TablebaseProbe(board, player, &tbResult)) {
+    node->score = tablebaseScore(tbResult, ply);
+    return true;
+  }
+
+  MobilityFromBoard(board, player, Bool_False, mobility);
 
+  // If the player to move still has a jump the game goes on
+  if (!mobility->terminal) return false;
 
-void freeAllChildrenNodes(StateNodePool* pool, StateNode* node) {
-  // if (!node) return;
+  // Reading: the player to move has no more moves, they lost ply plies
+  // from the root
+  node->score = ply - SCORE_WIN;
 
-  // StateNode* freeNode;
-  // while (node) {
-  //   freeNode = node;
-  //   freeAllChildrenNodes(pool, freeNode->firstChild);
-  //   node = node->next;
-  //   StateNodePoolFree(pool, freeNode);
-  // }
-  Arena* arena = pool->arena;
-  ArenaReset(arena);
-  StateNodePoolInit(arena);
+  return true; 
 }
 
 
-bool isOver(StateNode* node, I32 maximizingPlayer) {
-  U64 whitePieces = 0, blackPieces = 0;
-  U64 whiteSpots = getPlayerEmptySpace(node->board, PlayerKind_White);
-  U8 counter = 0;
-  U64 checker = whiteSpots, jumpSpace;
-  U64 startSpot;
-  while (checker) {
-    jumpSpace = checker & 1;
-    if (jumpSpace) {
-      startSpot = jumpSpace << counter;
-      U8 piecesList[4];
-      getMovablePieces(piecesList, startSpot, node->board, PlayerKind_White);
-      addMovablePieces(node, piecesList, &whitePieces, startSpot, PlayerKind_White);
+// Children best first for the player to move at node, going by the scores
+// the last search left on them. Those are for the player to move at the
+// child, so the lowest comes first. Ties keep the order they were made in.
+static void treeOrderChildren(TreePool *pool, const TreeNode *node, U8 *order) {
+  for (U32 i = 0; i < node->childCount; i++) {
+    I32 score = TreeNodeGet(pool, node->firstChild + i)->score;
+    U32 j = i;
+    while (j > 0 && TreeNodeGet(pool, node->firstChild + order[j-1])->score > score) {
+      order[j] = order[j-1];
+      j--;
     }
-    checker >>= 1;
-    counter++;
+    order[j] = i;
   }
+}
 
-  // Same thing as white pieces but with black pieces.
-  U64 blackSpots = getPlayerEmptySpace(node->board, PlayerKind_Black);
-  counter = 0;
-  checker = blackSpots;
-  while (checker) {
-    jumpSpace = checker & 1;
-    if (jumpSpace) {
-      startSpot = jumpSpace << counter;
-      U8 piecesList[4];
-      getMovablePieces(piecesList, startSpot, node->board, PlayerKind_Black);
-      addMovablePieces(node, piecesList, &blackPieces, startSpot, PlayerKind_Black);
+
+// The original search: every position becomes a TreeNode in the pool
+static void agentMoveTree(Agent *agent, BitBoard* board) {
+  U8 agentPlayer = agent->player;
+  TreePool *pool = agent->tree;
+  U64 budget = agent->moveTime * NANOSECONDS_PER_MILLISECOND;
+  pthread_mutex_lock(&agent->ponderLock);
+  agent->searchStart = TimerNow();
+  pthread_mutex_unlock(&agent->ponderLock);
+  TreeSearch search = { .pool = pool, .deadline = agent->searchStart + budget };
+
+  // Last move's tree is still there under the move we played. If the
+  // opponent's reply is in it, that subtree, with its scores and child
+  // order, is where this search starts. The rest goes back to the pool.
+  TreeIndex root = TREE_NONE;
+  if (agent->treeRoot) {
+    agent->treeRoot = TreeKeepChild(pool, agent->treeRoot, agent->treePlayed);
+    TreeNode *previous = TreeNodeGet(pool, agent->treeRoot);
+    U32 reply = 0;
+    while (reply < previous->childCount && TreeNodeGet(pool, previous->firstChild + reply)->board != board->whole) reply++;
+    if (reply < previous->childCount) {
+      root = TreeKeepChild(pool, agent->treeRoot, reply);
+      printf("Reusing the tree under the opponent's move\n");
+    } else {
+      TreeFree(pool, agent->treeRoot);
     }
-    checker >>= 1;
-    counter++;
+    agent->treeRoot = TREE_NONE;
   }
 
-  // If the player is checking for loss and they still have pieces, return false
-  if ((maximizingPlayer && whitePieces) || (!maximizingPlayer && blackPieces)) return false;
+  // Everything but the kept subtree was just freed, so the pool can only
+  // be full here if nodes leaked. The node free search still finds a move.
+  if (!root) root = TreeNodeAlloc(pool, *board);
+  if (root && !(TreeNodeGet(pool, root)->flags & TreeFlag_Expanded)) {
+    if (TreeNodeExpand(pool, root, agentPlayer)) {
+      search.statesCreated += TreeNodeGet(pool, root)->childCount;
+    } else {
+      TreeFree(pool, root);
+      root = TREE_NONE;
+    }
+  }
+  if (!root) {
+    printf("The tree pool is full, searching without it\n");
+    SearchResult result;
+    agentMoveAlphaBeta(agent, board, &result);
+    return;
+  }
+  TreeNode *stateNode = TreeNodeGet(pool, root);
+
+  // Iterative deepening like the alpha-beta engines: every child gets
+  // searched and scored by negamaxTree(), best first by the scores the
+  // iteration before left, or the last move's search did. An iteration
+  // the deadline cuts short does not count, the move is the best of the
+  // last one that finished.
+  U8 order[MAX_MOVES];
+  treeOrderChildren(pool, stateNode, order);
+  U32 best = order[0];
+  I32 completedDepth = 0;
+  for (I32 depth = max(agent->depth, 1); stateNode->childCount && depth < MAX_PLY; depth++) {
+    treeOrderChildren(pool, stateNode, order);
+    for (U32 i = 0; i < stateNode->childCount && !search.stopped; i++) {
+      negamaxTree(&search, stateNode->firstChild + order[i], 1, depth, -SCORE_INFINITE, SCORE_INFINITE,
+                  PlayerOpponent(agentPlayer));
+    }
+    if (search.stopped) break;
 
-  // Reading: we are black, we have no more pieces. This move will lead to a win for white
-  // set score to INT_MAX
-  if (!maximizingPlayer && !blackPieces) node->score = INT_MAX;
+    completedDepth = depth;
+    best = 0;
+    for (U32 i = 1; i < stateNode->childCount; i++) {
+      if (TreeNodeGet(pool, stateNode->firstChild + i)->score < TreeNodeGet(pool, stateNode->firstChild + best)->score) best = i;
+    }
 
-  // Reading: we are white, we have no more pieces. This move will lead to a win for black
-  // set score to INT_MIN 
-  if (maximizingPlayer && !whitePieces) node->score = INT_MIN;
+    // Same early stops as searchThreadIterate()
+    I32 score = -TreeNodeGet(pool, stateNode->firstChild + best)->score;
+    if (stateNode->childCount == 1) break;
+    if ((TimerNow() - agent->searchStart) * 2 >= budget) break;
+    if (agent->maxDepth && depth >= agent->maxDepth) break;
+    if ((ScoreIsWin(score) || ScoreIsLoss(score)) && depth >= SCORE_WIN - abs(score)) break;
+  }
+  double seconds = TimerSeconds(TimerNow() - agent->searchStart);
+  printf("Reached depth %d in %.3f seconds\nwith %llu nodes searched and %llu non-unique states created\n",
+         completedDepth, seconds, search.nodes, search.statesCreated);
+  printf("%u of %u tree nodes in use\n\n", pool->used, pool->capacity);
+
+  // Go through all children and print their score, which is ours after
+  // the move so the opposite of theirs
+  for (U32 i = 0; i < stateNode->childCount; i++) {
+    TreeNode *child = TreeNodeGet(pool, stateNode->firstChild + i);
+    char text[MOVE_LENGTH];
+    MoveToText(TreeNodeMove(stateNode, child), text);
+    printf("Move %s leads to state score: %d\n", text, -child->score);
+  }
+  if (stateNode->childCount) stateNode->score = -TreeNodeGet(pool, stateNode->firstChild + best)->score;
+  
+  if (!stateNode->childCount) {
+    printf("\nAgent move: \nLost");
+    TreeFree(pool, root);
+    return;
+  }
 
-  return true; 
+  TreeNode *newState = TreeNodeGet(pool, stateNode->firstChild + best);
+  char text[MOVE_LENGTH];
+  MoveToText(TreeNodeMove(stateNode, newState), text);
+  printf("\nAgent move: %s\n", text);
+  board->whole = newState->board;
+
+  // Keep what we know about the opponent's replies for next time. Freeing
+  // the other moves' subtrees takes a while, so that waits for the next
+  // search, where it comes out of the budget.
+  agent->treeRoot = root;
+  agent->treePlayed = best;
 }
 
 
-void agentMove(U8 agentPlayer, BitBoard* board, StateNodePool *pool, int depth) {
-  // printf("Agent move: ");
+// Searches every root move to depth in the current order inside the window
+// (alpha, beta). The first move gets the whole window and the rest a null
+// window, which only proves they are no better, unless they turn out to be.
+// *score is the best score, only a bound if it is outside the window.
+// Returns false if the deadline cut it short, in which case scores and the
+// principal variation are not to be trusted.
+static Bool searchRoot(SearchContext *ctx, MoveList *rootMoves, I32 *scores, I32 depth, PlayerKind player,
+                       I32 alpha, I32 beta, I32 *score) {
+  PlayerKind opponent = PlayerOpponent(player);
+  I32 bestEval = -SCORE_INFINITE;
+  ctx->followPv = Bool_True;
+
+  for (U32 i = 0; i < rootMoves->count; i++) {
+    Move move = rootMoves->moves[i];
+    U64 mask = MoveMask(move);
+    U64 keyChange = ZobristFromBits(mask) ^ zobristBlackToMove;
+    ctx->board.whole ^= mask;
+    ctx->key ^= keyChange;
+    I32 eval;
+    if (i == 0) {
+      eval = -negamax(ctx, 1, depth - 1, -beta, -alpha, opponent);
+    } else {
+      eval = -negamax(ctx, 1, depth - 1, -alpha - 1, -alpha, opponent);
+      if (!ctx->stopped && eval > alpha && eval < beta) eval = -negamax(ctx, 1, depth - 1, -beta, -alpha, opponent);
+    }
+    ctx->board.whole ^= mask;
+    ctx->key ^= keyChange;
+    ctx->followPv = Bool_False;
+
+    if (ctx->stopped) return Bool_False;
+    scores[i] = eval;
+
+    if (eval > bestEval) {
+      bestEval = eval;
+      ctx->pv[0][0] = move;
+      memcpy(&ctx->pv[0][1], ctx->pv[1], ctx->pvLength[1] * sizeof(Move));
+      ctx->pvLength[0] = ctx->pvLength[1] + 1;
+    }
+    alpha = max(alpha, eval);
+    if (alpha >= beta) break;
+  }
 
-  U64 allPlayerBoard = (agentPlayer == PlayerKind_White) ? ALL_WHITE : ALL_BLACK;
-  
-  char playerStartingMoves[2][3];
-  if (agentPlayer == PlayerKind_White) {
-    strcpy(playerStartingMoves[0], "D4");
-    strcpy(playerStartingMoves[1], "E5");
-  } else {
-    strcpy(playerStartingMoves[0], "D5");
-    strcpy(playerStartingMoves[1], "E4");
+  *score = bestEval;
+  return Bool_True;
+}
+
+
+// Best first, so the next iteration starts with the principal variation.
+// Insertion sort keeps the old order between equal scores.
+static void sortRootMoves(MoveList *rootMoves, I32 *scores) {
+  for (U32 i = 1; i < rootMoves->count; i++) {
+    Move move = rootMoves->moves[i];
+    I32 score = scores[i];
+    U32 j = i;
+    while (j > 0 && scores[j-1] < score) {
+      rootMoves->moves[j] = rootMoves->moves[j-1];
+      scores[j] = scores[j-1];
+      j--;
+    }
+    rootMoves->moves[j] = move;
+    scores[j] = score;
   }
-  char randomStart[3];
-  strcpy(randomStart, playerStartingMoves[rand() % 2]);
+}
 
-  // First move
-  if (!((board->whole & allPlayerBoard) ^ allPlayerBoard)) {
-    printf("%s\n", randomStart);
-    board->whole ^= 1llu<<IndexFromCoord(CoordFromInput(randomStart));
-    return;
+
+void AgentThreadsInit(Agent *agent, Arena *arena, U32 threadCount) {
+  agent->threadCount = max(threadCount, 1);
+  agent->arena = arena;
+  agent->threads = ArenaPush(arena, agent->threadCount * sizeof(SearchThread));
+
+  // Each thread gets its own arena so they never fight over one
+  for (U32 i = 0; i < agent->threadCount; i++) {
+    SearchThread *thread = &agent->threads[i];
+    thread->index = i;
+    thread->arena = ArenaInit(sizeof(SearchContext) + Megabyte(1));
+    thread->ctx = ArenaPush(thread->arena, sizeof(SearchContext));
+    pthread_mutex_init(&thread->ctx->splitLock, NULL);
   }
 
-  // Determine best move: Generate children of possible moves
-  U64 statesCreated = 0;
-  StateNode* stateNode = StateNodePoolAlloc(pool);
-  stateNode->board = *board;
-  StateNodeGenerateChildren(pool, stateNode, agentPlayer, &statesCreated);
+  agent->threadPool = (agent->threadCount > 1) ? ThreadPoolInit(arena, agent->threadCount - 1) : NULL;
+  pthread_mutex_init(&agent->ponderLock, NULL);
+}
 
-  
 
-  // Go through all children and set their score as minimax()
-  U64 startTime = time(NULL);
-  U64 currTime = time(NULL);
-  while (currTime - startTime <= MAX_TIME - 15) {
-    for (StateNode* child = stateNode->firstChild; child; child=child->next) {
-      child->score = minimax(pool, child, depth, INT_MIN, INT_MAX, (agentPlayer == PlayerKind_White) ?
-      false : true, &statesCreated);
+void AgentThreadsDeinit(Agent *agent) {
+  AgentPonderStop(agent, (BitBoard){0});
+  pthread_mutex_destroy(&agent->ponderLock);
+  if (agent->threadPool) ThreadPoolDeinit(agent->threadPool);
+  for (U32 i = 0; i < agent->threadCount; i++) {
+    pthread_mutex_destroy(&agent->threads[i].ctx->splitLock);
+    ArenaDeinit(agent->threads[i].arena);
+  }
+  agent->threadPool = NULL;
+  agent->threadCount = 0;
+}
+
+
+/*
+ * Iterative deepening for one thread. The main thread (index 0) owns the
+ * deadline and the early stops, helpers just keep going until the main
+ * thread sets agent->abort. To keep helpers from walking in lock step with
+ * the main thread the odd ones start a ply deeper, and every helper tries
+ * the moves after the best one in a rotated order.
+ */
+// The clock only runs once pondering has turned into a real search
+static Bool agentPondering(Agent *agent, U64 *searchStart) {
+  pthread_mutex_lock(&agent->ponderLock);
+  Bool pondering = agent->pondering;
+  *searchStart = agent->searchStart;
+  pthread_mutex_unlock(&agent->ponderLock);
+  return pondering;
+}
+
+
+static void searchContextReset(Agent *agent, SearchThread *thread) {
+  SearchContext *ctx = thread->ctx;
+  U64 budget = agent->moveTime * NANOSECONDS_PER_MILLISECOND;
+
+  ctx->board = agent->searchBoard;
+  ctx->key = ZobristFromBoard(agent->searchBoard, agent->player);
+  ctx->tt = agent->tt;
+  ctx->nodes = 0;
+  ctx->ttProbes = 0;
+  ctx->ttHits = 0;
+  ctx->tbHits = 0;
+  ctx->expanded = 0;
+  ctx->cutoffs = 0;
+  ctx->firstMoveCutoffs = 0;
+  ctx->iterationCount = 0;
+  // A ponder hit moves the deadline while we are searching, hence the lock
+  pthread_mutex_lock(&agent->ponderLock);
+  ctx->deadline = (thread->index == 0 && !agent->pondering) ? agent->searchStart + budget : ~0llu;
+  pthread_mutex_unlock(&agent->ponderLock);
+  ctx->nodeLimit = (thread->index == 0 && agent->maxNodes) ? agent->maxNodes : ~0llu;
+  ctx->abort = &agent->abort;
+  ctx->stopped = Bool_False;
+  ctx->followPv = Bool_False;
+  ctx->prevPvLength = 0;
+  ctx->completedDepth = 0;
+  ctx->splitting = (agent->engine == EngineKind_Ybwc && agent->threadCount > 1);
+  ctx->splitPoint = NULL;
+  // other threads may already be looking through our deque
+  pthread_mutex_lock(&ctx->splitLock);
+  ctx->splitCount = 0;
+  pthread_mutex_unlock(&ctx->splitLock);
+  MoveOrderingClear(&ctx->ordering);
+}
+
+
+static void searchThreadIterate(Agent *agent, SearchThread *thread) {
+  SearchContext *ctx = thread->ctx;
+  U8 agentPlayer = agent->player;
+  U64 budget = agent->moveTime * NANOSECONDS_PER_MILLISECOND;
+  Bool isMain = (thread->index == 0);
+
+  searchContextReset(agent, thread);
+
+  MoveList *rootMoves = &ctx->moves[0];
+  GenerateMoves(agent->searchBoard, agentPlayer, rootMoves);
+  I32 iterationScores[MAX_MOVES];
+  for (U32 i = 0; i < rootMoves->count; i++) ctx->rootScores[i] = 0;
+  I32 score = 0;
+
+  I32 depth = max(agent->depth, 1) + ((isMain) ? 0 : (thread->index & 1));
+  for (; rootMoves->count && depth < MAX_PLY; depth++) {
+    if (!isMain && rootMoves->count > 2) {
+      U32 shift = thread->index % (rootMoves->count - 1);
+      for (U32 i = 0; i < shift; i++) {
+        Move first = rootMoves->moves[1];
+        memmove(&rootMoves->moves[1], &rootMoves->moves[2], (rootMoves->count - 2) * sizeof(Move));
+        rootMoves->moves[rootMoves->count - 1] = first;
+      }
+    }
+
+    // Aspiration: expect about the last iteration's score and search a
+    // narrow window around it, widening whichever side it falls out of
+    I32 delta = ASPIRATION_WINDOW;
+    I32 alpha = -SCORE_INFINITE, beta = SCORE_INFINITE;
+    if (depth >= ASPIRATION_MIN_DEPTH && ctx->completedDepth && !ScoreIsWin(score) && !ScoreIsLoss(score)) {
+      alpha = score - delta;
+      beta = score + delta;
     }
-    depth++;
-    currTime = time(NULL);
+
+    U64 iterationStart = TimerNow();
+    U64 iterationNodes = ctx->nodes;
+    Bool finished;
+    I32 iterationScore;
+    for (;;) {
+      finished = searchRoot(ctx, rootMoves, iterationScores, depth, agentPlayer, alpha, beta, &iterationScore);
+      if (!finished) break;
+      delta *= 2;
+      if (iterationScore <= alpha) alpha = max(iterationScore - delta, -SCORE_INFINITE);
+      else if (iterationScore >= beta) beta = min(iterationScore + delta, SCORE_INFINITE);
+      else break;
+    }
+    if (isMain) {
+      ctx->iterations[ctx->iterationCount++] = (SearchIteration){
+        .depth = depth,
+        .completed = finished,
+        .nodes = ctx->nodes - iterationNodes,
+        .time = TimerNow() - iterationStart,
+      };
+    }
+    if (!finished) break;
+
+    score = iterationScore;
+    ctx->completedDepth = depth;
+    memcpy(ctx->rootScores, iterationScores, rootMoves->count * sizeof(I32));
+    sortRootMoves(rootMoves, ctx->rootScores);
+    memcpy(ctx->prevPv, ctx->pv[0], ctx->pvLength[0] * sizeof(Move));
+    ctx->prevPvLength = ctx->pvLength[0];
+
+    // With one move there is nothing to think about, and an iteration
+    // takes longer than all the ones before it, so past half the budget
+    // the next one would almost certainly be thrown away.
+    U64 searchStart;
+    if (isMain && rootMoves->count == 1 && !agent->solve) break;
+    if (isMain && !agentPondering(agent, &searchStart) && (TimerNow() - searchStart) * 2 >= budget) break;
+    if (isMain && agent->maxDepth && depth >= agent->maxDepth) break;
+    // A forced result seen within the depth will not change by looking deeper
+    if (isMain && (ScoreIsWin(score) || ScoreIsLoss(score)) && depth >= SCORE_WIN - abs(score)) break;
   }
-  printf("Reached depth %d in %llu seconds\nwith %llu non-unique states created\n\n", depth-1, currTime - startTime, statesCreated);
+}
+
+
+static void helperSearchJob(void *data, U32 threadIndex) {
+  Agent *agent = data;
+  searchThreadIterate(agent, &agent->threads[threadIndex]);
+}
+
 
-  // Go through all children and print their score
-  I32 bestScore = (agentPlayer == PlayerKind_White) ? INT_MAX : INT_MIN;
-  StateNode* newState = stateNode->firstChild;
-  for (StateNode* child = stateNode->firstChild; child; child=child->next) {
-    if (agentPlayer == PlayerKind_White && child->score > newState->score) newState = child;
-    else if (agentPlayer == PlayerKind_Black && child->score < newState->score) newState = child;
-    printf("Move %s leads to state score: %d\n", child->move, child->score);
+// A split point is cut off if it or anything it was split under is
+static inline Bool splitPointCutoff(SplitPoint *sp) {
+  for (; sp; sp = sp->parent) {
+    if (__atomic_load_n(&sp->cutoff, __ATOMIC_RELAXED)) return Bool_True;
   }
-  
-  printf("\nAgent move: %s\n", newState->move);
-  if (newState->move[0] == '\0') {
-    printf("Lost");
+  return Bool_False;
+}
+
+
+/*
+ * Searches moves of a split point until there are none left or someone
+ * finds a cutoff. Run by the owner and by every thread that joins. ctx->board
+ * must already be the split point's board.
+ */
+static void ybwcWork(SearchContext *ctx, SplitPoint *sp) {
+  SplitPoint *outer = ctx->splitPoint;
+  ctx->splitPoint = sp;
+
+  for (;;) {
+    U32 i = __atomic_fetch_add(&sp->nextMove, 1, __ATOMIC_RELAXED);
+    if (i >= sp->moves->count || splitPointCutoff(sp)) break;
+
+    pthread_mutex_lock(&sp->lock);
+    I32 alpha = sp->alpha, beta = sp->beta;
+    pthread_mutex_unlock(&sp->lock);
+
+    // Only younger brothers get here, so they start with a null window
+    Move move = sp->moves->moves[i];
+    PlayerKind opponent = PlayerOpponent(sp->player);
+    U64 mask = MoveMask(move);
+    U64 keyChange = ZobristFromBits(mask) ^ zobristBlackToMove;
+    ctx->board.whole ^= mask;
+    ctx->key ^= keyChange;
+    I32 eval = -negamax(ctx, sp->ply + 1, sp->depth - 1, -alpha - 1, -alpha, opponent);
+    if (!ctx->stopped && eval > alpha && eval < beta) eval = -negamax(ctx, sp->ply + 1, sp->depth - 1, -beta, -alpha, opponent);
+    ctx->board.whole ^= mask;
+    ctx->key ^= keyChange;
+
+    if (ctx->stopped) break;
+
+    pthread_mutex_lock(&sp->lock);
+    if (eval > sp->bestEval) {
+      sp->bestEval = eval;
+      sp->bestMove = move;
+      if (ctx == sp->owner) {
+        ctx->pv[sp->ply][0] = move;
+        memcpy(&ctx->pv[sp->ply][1], ctx->pv[sp->ply+1], ctx->pvLength[sp->ply+1] * sizeof(Move));
+        ctx->pvLength[sp->ply] = ctx->pvLength[sp->ply+1] + 1;
+      }
+    }
+    sp->alpha = max(sp->alpha, eval);
+    if (sp->alpha >= sp->beta && !sp->cutoff) {
+      __atomic_store_n(&sp->cutoff, Bool_True, __ATOMIC_RELAXED);
+      TelemetryCount(ctx->cutoffs);
+      MoveOrderingCutoff(&ctx->ordering, move, sp->ply, sp->depth);
+    }
+    pthread_mutex_unlock(&sp->lock);
   }
-  *board = newState->board;
 
-  // Free all children of our state node
-  freeAllChildrenNodes(pool, stateNode);
+  ctx->splitPoint = outer;
 }
 
 
-// score < 0: black favoured (black has more pieces to move)
-// score > 0: white favoured (white has more pieces to move)
-// score = 0: equal pieces move
-void StateNodeCalcCost(StateNode* node) {
-  // These hold the pieces that are able to move
-  U64 whitePieces = 0, blackPieces = 0;
-  U64 whiteEdgePieces = 0, blackEdgePieces = 0;
-  U64 whiteCornerPieces = 0, blackCornerPieces = 0;
-  
-  U8 counter;
-  U64 checker, jumpSpace;
-  U64 startSpot;
+/*
+ * Called by negamax() after the eldest brother has been searched. Puts
+ * the rest of the moves on our deque, works on them with whoever steals
+ * them and waits for the helpers to leave, since the split point lives on
+ * our stack. Returns the results through the pointers.
+ */
+static void ybwcSplit(SearchContext *ctx, MoveList *list, I32 ply, I32 depth, PlayerKind player,
+                      I32 *alpha, I32 beta, I32 *bestEval, Move *bestMove) {
+  SplitPoint sp = {
+    .parent = ctx->splitPoint,
+    .owner = ctx,
+    .board = ctx->board,
+    .key = ctx->key,
+    .ply = ply,
+    .depth = depth,
+    .player = player,
+    .moves = list,
+    .nextMove = 1,
+    .workers = 1,
+    .alpha = *alpha,
+    .beta = beta,
+    .bestEval = *bestEval,
+    .bestMove = *bestMove,
+  };
+  pthread_mutex_init(&sp.lock, NULL);
+
+  pthread_mutex_lock(&ctx->splitLock);
+  ctx->splits[ctx->splitCount++] = &sp;
+  pthread_mutex_unlock(&ctx->splitLock);
+
+  ybwcWork(ctx, &sp);
+
+  pthread_mutex_lock(&ctx->splitLock);
+  ctx->splitCount--;
+  pthread_mutex_unlock(&ctx->splitLock);
+
+  pthread_mutex_lock(&sp.lock);
+  sp.finished = Bool_True;
+  pthread_mutex_unlock(&sp.lock);
+  while (__atomic_load_n(&sp.workers, __ATOMIC_ACQUIRE) > 1) sched_yield();
+
+  // If we were stopped by a cutoff in this split point, and not by the
+  // clock or one further out, the search of this node is still good
+  if (ctx->stopped && !__atomic_load_n(ctx->abort, __ATOMIC_RELAXED) && !splitPointCutoff(sp.parent)) {
+    ctx->stopped = Bool_False;
+  }
 
-  // Get white pieces empty spots
-  U64 whiteSpots = getPlayerEmptySpace(node->board, PlayerKind_White);
-
-  // This algo is really weird.
-  // In short, the algo will go through each square.
-  // If the square is empty, call getMovablePieces() to get all the pieces that can
-  // move into this square.
-  // & each direction with ALL_WHITE to get the piece that can move to the empty square
-  // | each piece with whitePieces
-  // Now we have all the whitePieces that can move
-  counter = 0;
-  checker = whiteSpots;
-  while (checker) {
-    jumpSpace = checker & 1;
-    if (jumpSpace) {
-      startSpot = (jumpSpace<<counter);
-      U8 piecesList[4];
-      getMovablePieces(piecesList, startSpot, node->board, PlayerKind_White);
-      addMovablePieces(node, piecesList, &whitePieces, startSpot, PlayerKind_White);
+  *alpha = sp.alpha;
+  *bestEval = sp.bestEval;
+  if (sp.bestMove != *bestMove && ctx->pv[ply][0] != sp.bestMove) {
+    ctx->pv[ply][0] = sp.bestMove;
+    ctx->pvLength[ply] = 1;
+  }
+  *bestMove = sp.bestMove;
+  pthread_mutex_destroy(&sp.lock);
+}
+
+
+// Looks through the other threads' deques, oldest split point first
+static SplitPoint *ybwcSteal(Agent *agent, SearchThread *self) {
+  for (U32 offset = 1; offset < agent->threadCount; offset++) {
+    SearchContext *victim = agent->threads[(self->index + offset) % agent->threadCount].ctx;
+    SplitPoint *found = NULL;
+
+    pthread_mutex_lock(&victim->splitLock);
+    for (U32 i = 0; i < victim->splitCount && !found; i++) {
+      SplitPoint *sp = victim->splits[i];
+      pthread_mutex_lock(&sp->lock);
+      if (!sp->finished && !sp->cutoff && __atomic_load_n(&sp->nextMove, __ATOMIC_RELAXED) < sp->moves->count) {
+        __atomic_add_fetch(&sp->workers, 1, __ATOMIC_RELAXED);
+        found = sp;
+      }
+      pthread_mutex_unlock(&sp->lock);
     }
-    checker >>= 1;
-    counter++;
+    pthread_mutex_unlock(&victim->splitLock);
+
+    if (found) return found;
   }
 
-  // Same thing as white pieces but with black pieces.
-  U64 blackSpots = getPlayerEmptySpace(node->board, PlayerKind_Black);
-  counter = 0;
-  checker = blackSpots;
-  while (checker) {
-    jumpSpace = checker & 1;
-    if (jumpSpace) {
-      startSpot = (jumpSpace<<counter);
-      U8 piecesList[4];
-      getMovablePieces(piecesList, startSpot, node->board, PlayerKind_Black);
-      addMovablePieces(node, piecesList, &blackPieces, startSpot, PlayerKind_Black);
+  return NULL;
+}
+
+
+// YBWC helpers never iterate themselves, they look for split points to
+// help with until the main thread is done
+static void ybwcHelperJob(void *data, U32 threadIndex) {
+  Agent *agent = data;
+  SearchThread *thread = &agent->threads[threadIndex];
+  SearchContext *ctx = thread->ctx;
+  searchContextReset(agent, thread);
+
+  while (!__atomic_load_n(&agent->abort, __ATOMIC_RELAXED)) {
+    SplitPoint *sp = ybwcSteal(agent, thread);
+    if (!sp) {
+      sched_yield();
+      continue;
     }
-    checker >>= 1;
-    counter++;
+
+    ctx->board = sp->board;
+    ctx->key = sp->key;
+    ctx->followPv = Bool_False;
+    ybwcWork(ctx, sp);
+    ctx->stopped = Bool_False;
+    __atomic_sub_fetch(&sp->workers, 1, __ATOMIC_RELEASE);
+  }
+}
+
+
+// AgentSearch() once the clock and agent->abort are set up
+static void agentSearchStarted(Agent *agent, BitBoard board, SearchResult *result) {
+  agent->searchBoard = board;
+  TTNewSearch(agent->tt);
+
+  if (agent->threadPool) {
+    ThreadPoolStart(agent->threadPool, (agent->engine == EngineKind_Ybwc) ? ybwcHelperJob : helperSearchJob, agent);
+  }
+  searchThreadIterate(agent, &agent->threads[0]);
+  __atomic_store_n(&agent->abort, Bool_True, __ATOMIC_RELAXED);
+  if (agent->threadPool) ThreadPoolWait(agent->threadPool);
+
+  SearchContext *best = agent->threads[0].ctx;
+  memset(result, 0, sizeof(SearchResult));
+  for (U32 i = 0; i < agent->threadCount; i++) {
+    SearchContext *ctx = agent->threads[i].ctx;
+    if (ctx->completedDepth > best->completedDepth) best = ctx;
+    result->nodes += ctx->nodes;
+    result->ttProbes += ctx->ttProbes;
+    result->ttHits += ctx->ttHits;
+    result->tbHits += ctx->tbHits;
+    result->expanded += ctx->expanded;
+    result->cutoffs += ctx->cutoffs;
+    result->firstMoveCutoffs += ctx->firstMoveCutoffs;
+  }
+
+  SearchContext *mainCtx = agent->threads[0].ctx;
+  result->iterationCount = mainCtx->iterationCount;
+  memcpy(result->iterations, mainCtx->iterations, mainCtx->iterationCount * sizeof(SearchIteration));
+
+  result->rootMoves = best->moves[0];
+  memcpy(result->scores, best->rootScores, best->moves[0].count * sizeof(I32));
+  result->depth = best->completedDepth;
+  U64 searchStart;
+  agentPondering(agent, &searchStart);
+  result->time = TimerNow() - searchStart;
+  result->reply = MOVE_NONE;
+  if (best->prevPvLength > 1 && best->prevPv[0] == result->rootMoves.moves[0]) result->reply = best->prevPv[1];
+}
+
+
+// Node free search: iterative deepening over the root moves with negamax()
+// which plays and takes back moves on a single board. Every iteration must
+// finish before the deadline to count. The thread that completed the
+// deepest iteration picks the move, the main thread wins ties.
+void AgentSearch(Agent *agent, BitBoard board, SearchResult *result) {
+  pthread_mutex_lock(&agent->ponderLock);
+  agent->pondering = Bool_False;
+  agent->searchStart = TimerNow();
+  pthread_mutex_unlock(&agent->ponderLock);
+  __atomic_store_n(&agent->abort, Bool_False, __ATOMIC_RELAXED);
+  agentSearchStarted(agent, board, result);
+}
+
+
+static void *ponderThreadMain(void *data) {
+  Agent *agent = data;
+  agentSearchStarted(agent, agent->ponderBoard, &agent->ponderResult);
+  return NULL;
+}
+
+
+// Starts searching the board after the reply we expect, if we expect one.
+// Everything agentSearchStarted() reads is set up here, before the thread
+// exists, so AgentPonderStop() can never run ahead of it.
+void AgentPonderStart(Agent *agent, BitBoard board) {
+  if (!agent->ponder || agent->ponderMove == MOVE_NONE || agent->ponderRunning) return;
+
+  agent->ponderBoard.whole = board.whole ^ MoveMask(agent->ponderMove);
+  pthread_mutex_lock(&agent->ponderLock);
+  agent->pondering = Bool_True;
+  agent->searchStart = TimerNow();
+  pthread_mutex_unlock(&agent->ponderLock);
+  __atomic_store_n(&agent->abort, Bool_False, __ATOMIC_RELAXED);
+  agent->ponderRunning = !pthread_create(&agent->ponderThread, NULL, ponderThreadMain, agent);
+}
+
+
+/*
+ * On a ponder hit the search keeps going and our clock starts now, the
+ * next agentMove() waits for it. On a miss it is stopped straight away,
+ * what it put in the table is all that is left of it.
+ */
+void AgentPonderStop(Agent *agent, BitBoard board) {
+  if (!agent->ponderRunning) return;
+
+  if (board.whole == agent->ponderBoard.whole) {
+    U64 now = TimerNow();
+    pthread_mutex_lock(&agent->ponderLock);
+    agent->pondering = Bool_False;
+    agent->searchStart = now;
+    __atomic_store_n(&agent->threads[0].ctx->deadline, now + agent->moveTime * NANOSECONDS_PER_MILLISECOND, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&agent->ponderLock);
+    return;
+  }
+
+  __atomic_store_n(&agent->abort, Bool_True, __ATOMIC_RELAXED);
+  pthread_join(agent->ponderThread, NULL);
+  agent->ponderRunning = Bool_False;
+}
+
+
+// Playouts on every thread until the move time is up. MCTS shares the
+// thread pool with the alpha-beta engines but not the table.
+static void agentMoveMcts(Agent *agent, BitBoard* board) {
+  U64 start = TimerNow();
+  U64 deadline = start + agent->moveTime * NANOSECONDS_PER_MILLISECOND;
+  Move move;
+  U64 playouts = MctsSearch(agent->mcts, agent->threadPool, *board, agent->player, deadline, &move);
+
+  double seconds = TimerSeconds(TimerNow() - start);
+  printf("Ran %llu playouts in %.3f seconds on %u threads (%.0f playouts/second)\n%u tree nodes\n\n",
+         playouts, seconds, agent->threadCount, (seconds > 0) ? playouts / seconds : 0.0,
+         min(agent->mcts->count, agent->mcts->capacity));
+
+  MctsNode *root = &agent->mcts->nodes[0];
+  for (U32 i = 0; i < root->childCount; i++) {
+    MctsNode *child = &agent->mcts->nodes[root->firstChild + i];
+    char text[MOVE_LENGTH];
+    MoveToText(MoveFromBoards(root->board, child->board), text);
+    printf("Move %s: %u visits, %.1f%% won\n", text, child->visits,
+           (child->visits) ? 100.0 * child->wins / child->visits : 0.0);
+  }
+
+  if (move == MOVE_NONE) {
+    printf("\nAgent move: \nLost");
+  } else {
+    char text[MOVE_LENGTH];
+    MoveToText(move, text);
+    printf("\nAgent move: %s\n", text);
+    board->whole ^= MoveMask(move);
+  }
+}
+
+
+// result is kept for the telemetry
+static void agentMoveAlphaBeta(Agent *agent, BitBoard* board, SearchResult *out) {
+  SearchResult result;
+  if (agent->ponderRunning) {
+    pthread_join(agent->ponderThread, NULL);
+    agent->ponderRunning = Bool_False;
+    result = agent->ponderResult;
+    printf("Ponder hit\n");
+  } else {
+    AgentSearch(agent, *board, &result);
+  }
+  *out = result;
+  agent->ponderMove = result.reply;
+
+  double seconds = TimerSeconds(result.time);
+  printf("Reached depth %d in %.3f seconds\nwith %llu nodes searched on %u threads (%.0f nodes/second)\n%llu of %llu table probes hit\n",
+         result.depth, seconds, result.nodes, agent->threadCount, (seconds > 0) ? result.nodes / seconds : 0.0,
+         result.ttHits, result.ttProbes);
+  if (tablebase.map) printf("%llu positions found in the tablebase\n", result.tbHits);
+  printf("\n");
+
+  // Only the root moves are ever turned into text, the best one is first
+  MoveList *rootMoves = &result.rootMoves;
+  for (U32 i = 0; i < rootMoves->count; i++) {
+    char text[MOVE_LENGTH];
+    MoveToText(rootMoves->moves[i], text);
+    printf("Move %s leads to state score: %d\n", text, result.scores[i]);
+  }
+
+  if (!rootMoves->count) {
+    printf("\nAgent move: \nLost");
+  } else {
+    char text[MOVE_LENGTH];
+    MoveToText(rootMoves->moves[0], text);
+    printf("\nAgent move: %s\n", text);
+    board->whole ^= MoveMask(rootMoves->moves[0]);
+  }
+
+}
+
+
+// Tries to solve the position exactly, in a quarter of the move time so the
+// search still has time if it can not. Returns false if the search has to
+// pick the move, which it also does when the solver says we lost, since
+// the opponent may still go wrong.
+static Bool agentMoveEndgame(Agent *agent, BitBoard *board) {
+  U64 start = TimerNow();
+  U64 deadline = start + agent->moveTime * NANOSECONDS_PER_MILLISECOND / 4;
+  Move move;
+  EndgameOutcome outcome = EndgameSolve(agent->endgame, *board, agent->player, deadline, &move);
+  double seconds = TimerSeconds(TimerNow() - start);
+
+  if (outcome == EndgameOutcome_Unknown) {
+    printf("Endgame not solved after %.3f seconds\n", seconds);
+    return Bool_False;
+  }
+  if (outcome == EndgameOutcome_Loss) {
+    printf("Endgame solved in %.3f seconds: lost against perfect play\n", seconds);
+    return Bool_False;
   }
 
-  //whiteEdgePieces |= (whitePieces & ALL_WHITE & EDGE_PIECES);
-  //blackEdgePieces |= (blackPieces & ALL_BLACK & EDGE_PIECES);
-  whiteCornerPieces |= (whitePieces & ALL_WHITE & CORNER_PIECES);
-  blackCornerPieces |= (blackPieces & ALL_BLACK & CORNER_PIECES);
+  char text[MOVE_LENGTH];
+  MoveToText(move, text);
+  printf("Endgame solved in %.3f seconds: won\n", seconds);
+  printf("\nAgent move: %s\n", text);
+  board->whole ^= MoveMask(move);
+  return Bool_True;
+}
+
 
-  node->score = ((__builtin_popcountll(whitePieces)-__builtin_popcountll(blackPieces)) + 
-                 (2*(__builtin_popcountll(whiteCornerPieces))) - (2*(__builtin_popcountll(blackCornerPieces)))
-                 );
+// After every searched move with --memory, so memory budgets can be sized
+// from real games and a leak shows up as bytes in use that only go up. On
+// stderr, stdout is the driver's.
+static void agentPrintMemory(Agent *agent) {
+  if (!agent->printMemory) return;
+  char name[32];
+  fprintf(stderr, "\nMemory:\n");
+  AllocStats stats = ArenaStats(agent->arena);
+  AllocStatsPrint(stderr, "agent arena", &stats);
+  for (U32 i = 0; i < agent->threadCount; i++) {
+    stats = ArenaStats(agent->threads[i].arena);
+    snprintf(name, sizeof(name), "arena %u", i);
+    AllocStatsPrint(stderr, name, &stats);
+  }
+  if (agent->tree) AllocStatsPrint(stderr, "tree pool", &agent->tree->stats);
+}
+
+
+static U64 agentMemoryBytes(Agent *agent) {
+  U64 bytes = ArenaStats(agent->arena).bytes;
+  for (U32 i = 0; i < agent->threadCount; i++) {
+    bytes += ArenaStats(agent->threads[i].arena).bytes;
+  }
+  if (agent->tree) bytes += agent->tree->stats.bytes;
+  if (agent->mcts) bytes += (U64)min(agent->mcts->count, agent->mcts->capacity) * sizeof(MctsNode);
+  return bytes;
+}
+
+
+static inline double safeRatio(U64 x, U64 y) {
+  return (y) ? (double)x / y : 0.0;
+}
+
+
+/*
+ * One JSON line per move on agent->telemetry, for finding regressions and
+ * tuning the clock from game logs. source says where the move came from,
+ * result is only there when the node free search picked it. The branching
+ * factor is the last completed iteration's nodes over the one before's.
+ */
+static void agentWriteTelemetry(Agent *agent, const char *source, BitBoard before, BitBoard after, U64 time,
+                                const SearchResult *result) {
+  FILE *out = agent->telemetry;
+  if (!out) return;
+
+  char played[MOVE_LENGTH] = "";
+  U64 changed = before.whole ^ after.whole;
+  if (PopCount(changed) == 1) bitToTextCoord(changed, played);
+  else if (changed) MoveToText(MoveFromBoards(before.whole, after.whole), played);
+
+  fprintf(out, "{\"move\":%u,\"player\":\"%c\",\"source\":\"%s\",\"played\":\"%s\",\"timeMs\":%.3f,\"memoryBytes\":%llu",
+          agent->movesMade, (agent->player == PlayerKind_White) ? 'W' : 'B', source, played,
+          time / (double)NANOSECONDS_PER_MILLISECOND, agentMemoryBytes(agent));
+
+  if (result) {
+    double seconds = TimerSeconds(result->time);
+    double branching = 0;
+    U32 completed = 0;
+    for (U32 i = 0; i < result->iterationCount; i++) completed += result->iterations[i].completed;
+    if (completed >= 2) branching = safeRatio(result->iterations[completed - 1].nodes, result->iterations[completed - 2].nodes);
+
+    fprintf(out, ",\"depth\":%d,\"nodes\":%llu,\"nodesPerSecond\":%.0f,\"threads\":%u,\"ttProbes\":%llu,\"ttHitRate\":%.4f,\"tbHits\":%llu",
+            result->depth, result->nodes, (seconds > 0) ? result->nodes / seconds : 0.0, agent->threadCount,
+            result->ttProbes, safeRatio(result->ttHits, result->ttProbes), result->tbHits);
+#if TELEMETRY
+    fprintf(out, ",\"cutoffRate\":%.4f,\"firstMoveCutoffRate\":%.4f",
+            safeRatio(result->cutoffs, result->expanded), safeRatio(result->firstMoveCutoffs, result->cutoffs));
+#endif
+    fprintf(out, ",\"branchingFactor\":%.3f,\"iterations\":[", branching);
+    for (U32 i = 0; i < result->iterationCount; i++) {
+      const SearchIteration *iteration = &result->iterations[i];
+      fprintf(out, "%s{\"depth\":%d,\"completed\":%s,\"nodes\":%llu,\"timeMs\":%.3f}", (i) ? "," : "",
+              iteration->depth, (iteration->completed) ? "true" : "false", iteration->nodes,
+              iteration->time / (double)NANOSECONDS_PER_MILLISECOND);
+    }
+    fprintf(out, "]");
+  }
+
+  fprintf(out, "}\n");
+  fflush(out);
+}
+
+
+void agentMove(Agent *agent, BitBoard* board) {
+  // printf("Agent move: ");
+  U8 agentPlayer = agent->player;
+  U64 start = TimerNow();
+  BitBoard before = *board;
+  SearchResult result;
+  agent->movesMade++;
+
+  // The opening book knows the first moves, including which stone to take
+  // off. Without one the first stone is picked at random.
+  Move move;
+  MoveList removals;
+  agent->ponderMove = MOVE_NONE;
+  if (agent->ponderRunning) {
+    // The opponent played the reply we were pondering on
+    agentMoveAlphaBeta(agent, board, &result);
+    agentPrintMemory(agent);
+    agentWriteTelemetry(agent, "ponder", before, *board, result.time, &result);
+    return;
+  }
+  if (!BookProbe(*board, agentPlayer, &move)) {
+    move = (OpeningRemovals(*board, agentPlayer, &removals)) ? removals.moves[rand() % removals.count] : MOVE_NONE;
+  }
+
+  // First move
+  if (move != MOVE_NONE && MoveIsRemoval(move)) {
+    char text[3];
+    bitToTextCoord(1llu << MoveFrom(move), text);
+    printf("%s\n", text);
+    board->whole ^= 1llu << MoveFrom(move);
+    agentWriteTelemetry(agent, "opening", before, *board, TimerNow() - start, NULL);
+    return;
+  }
+
+  if (move != MOVE_NONE) {
+    char text[MOVE_LENGTH];
+    MoveToText(move, text);
+    printf("Book move\n\nAgent move: %s\n", text);
+    board->whole ^= MoveMask(move);
+    agentWriteTelemetry(agent, "book", before, *board, TimerNow() - start, NULL);
+    return;
+  }
+
+  U64 movable = MovablePieces(*board, PlayerKind_White) | MovablePieces(*board, PlayerKind_Black);
+  if (agent->endgame && PopCount(movable) < agent->endgamePieces && agentMoveEndgame(agent, board)) {
+    agentWriteTelemetry(agent, "endgame", before, *board, TimerNow() - start, NULL);
+    return;
+  }
+
+  switch (agent->engine) {
+    case EngineKind_Tree:
+      agentMoveTree(agent, board);
+      agentWriteTelemetry(agent, "tree", before, *board, TimerNow() - start, NULL);
+      break;
+    case EngineKind_Mcts:
+      agentMoveMcts(agent, board);
+      agentWriteTelemetry(agent, "mcts", before, *board, TimerNow() - start, NULL);
+      break;
+    case EngineKind_AlphaBeta:
+    case EngineKind_Ybwc:
+    default:
+      agentMoveAlphaBeta(agent, board, &result);
+      agentWriteTelemetry(agent, "search", before, *board, TimerNow() - start, &result);
+      break;
+  }
+  agentPrintMemory(agent);
+}
+
+
+// score < 0: black favoured (black has more pieces to move)
+// score > 0: white favoured (white has more pieces to move)
+// score = 0: equal pieces move
+// The features are the ones EvalFeatures() gives tune.exe, weighted by
+// weights.h. A feature with no weight is never worked out.
+I32 MobilityEvaluate(const Mobility *mobility) {
+  U64 whitePieces = mobility->movable[PlayerKind_White];
+  U64 blackPieces = mobility->movable[PlayerKind_Black];
+  I32 score = 0;
+
+#if EVAL_WEIGHT_MOBILITY
+  score += EVAL_WEIGHT_MOBILITY * ((I32)PopCount(whitePieces) - (I32)PopCount(blackPieces));
+#endif
+#if EVAL_WEIGHT_CORNERS
+  score += EVAL_WEIGHT_CORNERS * ((I32)PopCount(whitePieces & CORNER_PIECES) - (I32)PopCount(blackPieces & CORNER_PIECES));
+#endif
+#if EVAL_WEIGHT_EDGES
+  score += EVAL_WEIGHT_EDGES * ((I32)PopCount(whitePieces & EDGE_PIECES) - (I32)PopCount(blackPieces & EDGE_PIECES));
+#endif
+#if EVAL_WEIGHT_PARITY
+  score += (mobility->toMove == PlayerKind_White) ? EVAL_WEIGHT_PARITY : -EVAL_WEIGHT_PARITY;
+#endif
+#if EVAL_WEIGHT_REGIONS
+  score += EVAL_WEIGHT_REGIONS * EvalRegions(mobility);
+#endif
+  return score;
+}
+
+
+// mobility must come from isOver() on the same node
+void TreeNodeCalcCost(TreeNode* node, const Mobility *mobility) {
+  node->score = MobilityEvaluate(mobility);
 }
 
 
 StateNode* StateNodeGenerateChildren(StateNodePool *pool, StateNode *parent, char playerKind, U64* statesCreated) {
-  // 0b01 if black pieces, 0b10 if white pieces
+  // The set-wise generator finds every jump at once, we only have to
+  // turn each one into a child node
+  MoveList list;
+  GenerateMoves(parent->board, playerKind, &list);
+
+  for (U32 i = 0; i < list.count; i++) {
+    createChildFromMove(pool, parent, list.moves[i]);
+    (*statesCreated)++;
+  }
+  // printf("Children count: %llu\n", StateNodeCountChildren(parent));
 
-  U64 currentSpace = (playerKind == PlayerKind_White) ? 0x2 : 0x1;
+  return parent->firstChild;
+}
+
+
+/*
+ * The old per square generator. For every empty square it looks for pieces
+ * that can land there with getMovablePieces(). It is far too slow for the
+ * search but it was written independently of GenerateMoves(), so perft
+ * uses it to check the fast generator.
+ */
+StateNode* StateNodeGenerateChildrenReference(StateNodePool *pool, StateNode *parent, char playerKind, U64* statesCreated) {
   U64 playerEmpty = getPlayerEmptySpace(parent->board, playerKind);
-  U64 allPlayer = (playerKind == PlayerKind_White) ? ALL_WHITE : ALL_BLACK;
   U64 startSpot;
 
   U8 counter = 0;
@@ -239,63 +1014,303 @@ StateNode* StateNodeGenerateChildren(StateNodePool *pool, StateNode *parent, cha
     checker >>= 1;
     counter++;
   }
-  // printf("Children count: %llu\n", StateNodeCountChildren(parent));
 
+  return parent->firstChild;
 }
 
 
-// For the minimax functions
-I32 minimax(StateNodePool *pool, StateNode* node, I32 depth, I32 alpha, I32 beta, I32 maximizingPlayer, U64* statesCreated) {
-  
-  // printf("Depth remaining: %d\n", depth);
+// Leaf count of the tree under node using the reference generator.
+// Children go back to the pool as soon as they are counted.
+U64 PerftReference(StateNodePool *pool, StateNode *node, char playerKind, U32 depth) {
+  if (depth == 0) return 1;
+
+  U64 statesCreated = 0;
+  StateNodeGenerateChildrenReference(pool, node, playerKind, &statesCreated);
+  if (depth == 1) {
+    U64 count = StateNodeCountChildren(node);
+    for (StateNode *child = node->firstChild, *next; child; child = next) {
+      next = child->next;
+      StateNodePoolFree(pool, child);
+    }
+    node->firstChild = node->lastChild = NULL;
+    return count;
+  }
+
+  U64 nodes = 0;
+  char opponent = (playerKind == PlayerKind_White) ? PlayerKind_Black : PlayerKind_White;
+  for (StateNode *child = node->firstChild, *next; child; child = next) {
+    next = child->next;
+    nodes += PerftReference(pool, child, opponent, depth - 1);
+    StateNodePoolFree(pool, child);
+  }
+  node->firstChild = node->lastChild = NULL;
+
+  return nodes;
+}
 
-  if (isOver(node, maximizingPlayer)) {
+
+// What negamaxTree() makes of a node at depth 0, with its mobility
+// already worked out
+static I32 treeLeaf(TreeNode *node, PlayerKind player, I32 ply, const Mobility *mobility) {
+  TablebaseResult tbResult;
+  if (TablebaseProbe((BitBoard){ .whole = node->board }, player, &tbResult)) {
+    node->score = tablebaseScore(tbResult, ply);
     return node->score;
   }
-  
-  if (maximizingPlayer) StateNodeGenerateChildren(pool, node, PlayerKind_White, statesCreated);
-  else StateNodeGenerateChildren(pool, node, PlayerKind_Black, statesCreated);
+  if (mobility->terminal) {
+    node->score = ply - SCORE_WIN;
+    return node->score;
+  }
+  TreeNodeCalcCost(node, mobility);
+  if (player == PlayerKind_Black) node->score = -node->score;
+  return node->score;
+}
+
 
-  if (depth == 0 || !node->firstChild) {
-    //Run Evaluation Function
-    StateNodeCalcCost(node);
+// Negamax over TreeNodes. Children are kept, so the next iteration and a
+// re-search after a null window walk the tree that is already there. Once
+// the pool is full a node that has no children yet is scored as a leaf.
+// Every node searched keeps its score, for the player to move there, and
+// the next search tries its children best first by those. Once the
+// deadline passes search->stopped is set and everything returns 0
+// without touching a score.
+I32 negamaxTree(TreeSearch *search, TreeIndex index, I32 ply, I32 depth, I32 alpha, I32 beta, PlayerKind player) {
+  TreePool *pool = search->pool;
+  if (!(++search->nodes & (CLOCK_CHECK_NODES - 1)) && TimerNow() >= search->deadline) search->stopped = Bool_True;
+  if (search->stopped) return 0;
+
+  TreeNode *node = TreeNodeGet(pool, index);
+  Mobility mobility;
+  if (isOver(node, player, ply, &mobility)) {
     return node->score;
   }
 
-  if (maximizingPlayer) {
-    I32 maxEval = INT_MIN;
+  if (depth == 0 || !(node->flags & TreeFlag_Expanded)) {
+    if (depth > 0 && TreeNodeExpand(pool, index, player)) {
+      search->statesCreated += node->childCount;
+    } else {
+      //Run Evaluation Function
+      TreeNodeCalcCost(node, &mobility);
+      if (player == PlayerKind_Black) node->score = -node->score;
+      return node->score;
+    }
+  }
 
-    // Generate children as white
-    //StateNodeGenerateChildren(pool, node, PlayerKind_White);
-    
-    for (StateNode* child = node->firstChild; child != NULL; child = child->next) {
-      I32 eval = minimax(pool, child, depth -1, alpha, beta, false, statesCreated);
-      maxEval = max(maxEval, eval);
-      alpha = max(alpha, eval);
-      if (beta <= alpha) {
-        break;
-      }
+  I32 bestEval = -SCORE_INFINITE;
+  PlayerKind opponent = PlayerOpponent(player);
+
+  // The children are all leaves, their mobility is worked out together
+  // with MobilityFromBoards() instead of one at a time in isOver()
+  Mobility leaves[MAX_MOVES];
+  if (depth == 1) {
+    BitBoard boards[MAX_MOVES];
+    PlayerKind toMove[MAX_MOVES];
+    for (U32 i = 0; i < node->childCount; i++) {
+      boards[i].whole = TreeNodeGet(pool, node->firstChild + i)->board;
+      toMove[i] = opponent;
     }
-    return maxEval;
+    MobilityFromBoards(boards, toMove, node->childCount, Bool_False, leaves);
+  }
+
+  U8 order[MAX_MOVES];
+  treeOrderChildren(pool, node, order);
+  for (U32 i = 0; i < node->childCount; i++) {
+    TreeIndex child = node->firstChild + order[i];
+    I32 eval;
+    if (depth == 1) {
+      eval = -treeLeaf(TreeNodeGet(pool, child), opponent, ply + 1, &leaves[order[i]]);
+    } else if (i == 0) {
+      eval = -negamaxTree(search, child, ply + 1, depth - 1, -beta, -alpha, opponent);
+    } else {
+      eval = -negamaxTree(search, child, ply + 1, depth - 1, -alpha - 1, -alpha, opponent);
+      if (!search->stopped && eval > alpha && eval < beta) eval = -negamaxTree(search, child, ply + 1, depth - 1, -beta, -alpha, opponent);
+    }
+    if (search->stopped) return 0;
+    bestEval = max(bestEval, eval);
+    alpha = max(alpha, eval);
+    if (alpha >= beta) {
+      break;
+    }
+  }
+
+  node->score = bestEval;
+  return bestEval;
+}
+
+
+// Win and loss scores count plies from the root. The table stores them
+// counted from the position instead, so they are still right when the
+// position is reached at another ply.
+static inline I32 scoreToTT(I32 score, I32 ply) {
+  if (ScoreIsWin(score)) return score + ply;
+  if (ScoreIsLoss(score)) return score - ply;
+  return score;
+}
+
+static inline I32 scoreFromTT(I32 score, I32 ply) {
+  if (ScoreIsWin(score)) return score - ply;
+  if (ScoreIsLoss(score)) return score + ply;
+  return score;
+}
+
+
+static I32 negamaxWhite(SearchContext *ctx, I32 ply, I32 depth, I32 alpha, I32 beta);
+static I32 negamaxBlack(SearchContext *ctx, I32 ply, I32 depth, I32 alpha, I32 beta);
+
+// Where player is a constant this is a direct call to that colour's negamax()
+static inline I32 negamaxFor(SearchContext *ctx, I32 ply, I32 depth, I32 alpha, I32 beta, PlayerKind player) {
+  return (player == PlayerKind_White) ? negamaxWhite(ctx, ply, depth, alpha, beta) : negamaxBlack(ctx, ply, depth, alpha, beta);
+}
+
+
+/*
+ * Same search as negamaxTree() but without any nodes. Moves for each ply are
+ * written into ctx->moves[ply] and played on ctx->board with an xor, so
+ * memory use only depends on the depth.
+ *
+ * It is compiled once for each colour, negamaxWhite() and negamaxBlack(),
+ * with player a constant. Every test of it folds away: the generator and
+ * the child's negamax() are called directly and the masks are immediates.
+ */
+static inline __attribute__((always_inline))
+I32 negamaxBody(SearchContext *ctx, I32 ply, I32 depth, I32 alpha, I32 beta, PlayerKind player) {
+  ctx->nodes++;
+  ctx->pvLength[ply] = 0;
+
+  // Reading the clock is not free so only do it every so often. Once the
+  // deadline has passed or the node limit is reached, or another thread says
+  // we are done, every node returns straight away and the caller throws the
+  // result out.
+  if (!(ctx->nodes & (CLOCK_CHECK_NODES - 1))) {
+    if (TimerNow() >= __atomic_load_n(&ctx->deadline, __ATOMIC_RELAXED) || ctx->nodes >= ctx->nodeLimit) {
+      __atomic_store_n(ctx->abort, Bool_True, __ATOMIC_RELAXED);
+    }
+    if (__atomic_load_n(ctx->abort, __ATOMIC_RELAXED)) ctx->stopped = Bool_True;
+  }
+  if (ctx->splitPoint && splitPointCutoff(ctx->splitPoint)) ctx->stopped = Bool_True;
+  if (ctx->stopped) return 0;
+
+  // Losing right here is as bad as it gets and winning on the next move as
+  // good, if the window is outside that there is nothing to search
+  alpha = max(alpha, ply - SCORE_WIN);
+  beta = min(beta, SCORE_WIN - ply - 1);
+  if (alpha >= beta) return alpha;
+
+  TablebaseResult tbResult;
+  if (TablebaseProbe(ctx->board, player, &tbResult)) {
+    ctx->tbHits++;
+    return tablebaseScore(tbResult, ply);
   }
 
-  else {
-    I32 minEval = INT_MAX;
+  if (depth == 0 || ply >= MAX_PLY - 1) {
+    Mobility mobility;
+    MobilityFromBoard(ctx->board, player, Bool_False, &mobility);
+    if (mobility.terminal) return ply - SCORE_WIN;
+    I32 eval = MobilityEvaluate(&mobility);
+    return (player == PlayerKind_White) ? eval : -eval;
+  }
 
-    // Generate children as black
-    //StateNodeGenerateChildren(pool, node, PlayerKind_Black);
+  // A position we have already searched deep enough never gets its moves generated
+  I32 alphaOrig = alpha, betaOrig = beta;
+  TTEntryData hit;
+  ctx->ttProbes++;
+  Bool ttFound = TTProbe(ctx->tt, ctx->key, &hit);
+  if (ttFound) {
+    ctx->ttHits++;
+    if (hit.depth >= depth) {
+      I32 score = scoreFromTT(hit.score, ply);
+      if (hit.bound == BoundKind_Exact) return score;
+      if (hit.bound == BoundKind_Lower) alpha = max(alpha, score);
+      else if (hit.bound == BoundKind_Upper) beta = min(beta, score);
+      if (beta <= alpha) return score;
+    }
+  }
 
-    for (StateNode* child = node->firstChild; child != NULL; child = child->next) {
-      I32 eval = minimax(pool, child, depth -1, alpha, beta, true, statesCreated);
-      minEval = min(minEval, eval);
-      beta = min(beta, eval);
-      if (beta <= alpha) {
+  MoveList *list = &ctx->moves[ply];
+  if (!GenerateMoves(ctx->board, player, list)) return ply - SCORE_WIN;
+  TelemetryCount(ctx->expanded);
+
+  // While we are still on the last iteration's principal variation its move
+  // goes first, otherwise the table's best move does
+  Move hashMove = (ttFound) ? hit.move : MOVE_NONE;
+  if (ctx->followPv) {
+    ctx->followPv = Bool_False;
+    if (ply < ctx->prevPvLength) {
+      for (U32 i = 0; i < list->count; i++) {
+        if (list->moves[i] != ctx->prevPv[ply]) continue;
+        hashMove = ctx->prevPv[ply];
+        ctx->followPv = Bool_True;
         break;
       }
     }
-    return minEval;
   }
+  OrderMoves(&ctx->ordering, list, ply, hashMove);
+
+  I32 bestEval = -SCORE_INFINITE;
+  Move bestMove = list->moves[0];
+  PlayerKind opponent = PlayerOpponent(player);
+  for (U32 i = 0; i < list->count; i++) {
+    // Young brothers wait for the eldest, then get shared out
+    if (i == 1 && ctx->splitting && depth >= YBWC_MIN_SPLIT_DEPTH) {
+      ybwcSplit(ctx, list, ply, depth, player, &alpha, beta, &bestEval, &bestMove);
+      if (ctx->stopped) return 0;
+      break;
+    }
+
+    // Principal variation search: with good ordering the first move is the
+    // best, so the rest only have to be shown to be worse with a null window,
+    // which is far cheaper. The few that are not get searched again.
+    U64 mask = MoveMaskFor(list->moves[i], player);
+    U64 keyChange = ZobristFromBits(mask) ^ zobristBlackToMove;
+    ctx->board.whole ^= mask;
+    ctx->key ^= keyChange;
+    I32 eval;
+    if (i == 0) {
+      eval = -negamaxFor(ctx, ply + 1, depth - 1, -beta, -alpha, opponent);
+    } else {
+      eval = -negamaxFor(ctx, ply + 1, depth - 1, -alpha - 1, -alpha, opponent);
+      if (!ctx->stopped && eval > alpha && eval < beta) eval = -negamaxFor(ctx, ply + 1, depth - 1, -beta, -alpha, opponent);
+    }
+    ctx->board.whole ^= mask;
+    ctx->key ^= keyChange;
+    ctx->followPv = Bool_False;
+
+    if (ctx->stopped) return 0;
+
+    if (eval > bestEval) {
+      bestEval = eval;
+      bestMove = list->moves[i];
+      ctx->pv[ply][0] = bestMove;
+      memcpy(&ctx->pv[ply][1], ctx->pv[ply+1], ctx->pvLength[ply+1] * sizeof(Move));
+      ctx->pvLength[ply] = ctx->pvLength[ply+1] + 1;
+    }
+    alpha = max(alpha, eval);
+    if (alpha >= beta) {
+      MoveOrderingCutoff(&ctx->ordering, list->moves[i], ply, depth);
+      TelemetryCount(ctx->cutoffs);
+      if (i == 0) TelemetryCount(ctx->firstMoveCutoffs);
+      break;
+    }
+  }
+
+  BoundKind bound = BoundKind_Exact;
+  if (bestEval <= alphaOrig) bound = BoundKind_Upper;
+  else if (bestEval >= betaOrig) bound = BoundKind_Lower;
+  TTStore(ctx->tt, ctx->key, depth, scoreToTT(bestEval, ply), bound, bestMove);
+
+  return bestEval;
+}
+
+static I32 negamaxWhite(SearchContext *ctx, I32 ply, I32 depth, I32 alpha, I32 beta) {
+  return negamaxBody(ctx, ply, depth, alpha, beta, PlayerKind_White);
+}
 
+static I32 negamaxBlack(SearchContext *ctx, I32 ply, I32 depth, I32 alpha, I32 beta) {
+  return negamaxBody(ctx, ply, depth, alpha, beta, PlayerKind_Black);
+}
+
+I32 negamax(SearchContext *ctx, I32 ply, I32 depth, I32 alpha, I32 beta, PlayerKind player) {
+  return negamaxFor(ctx, ply, depth, alpha, beta, player);
 }
 
 
@@ -436,85 +1451,6 @@ U64 StateNodeCountChildren(StateNode *node) {
 }
 
 
-void addMovablePieces(StateNode* node, U8* piecesList, U64* colorSpots, U64 startSpot, char colorPiece) {
-  // Make to function. Pass in U8* piecesList, U64* colorSpots, U64* startSpot, char player
-  // This function will modify colorSpots by | the inner U64 named 'pieces'
-  
-  U64 mask = (colorPiece == PlayerKind_White) ? ALL_WHITE : ALL_BLACK;
-  U64 newUp = 0, newLeft = 0, newDown = 0, newRight = 0;
-  U8 position;
-  U8 shifter;
-
-  // UP
-  position = 1;
-  U8 up = piecesList[0];
-  if (up) {
-    shifter = 0;
-    while (up) {
-      if (position & up) {
-        // start at startSpot, then left shift 8 * shifter times
-        newUp |= ((startSpot<<(8*shifter)) & mask);
-      }
-      up >>= 1;
-      shifter++;
-    }
-  }
-  
-  // LEFT
-  position = 1;
-  U8 left = piecesList[1];
-  if (left) {
-    shifter = 0;
-    while (left) {
-      if (position & left) {
-        // start at startSpot, then left shift shifter times
-        newLeft |= ((startSpot<<shifter) & mask);
-      }
-      left >>= 1;
-      shifter++;
-    }
-  }
-
-  // DOWN
-  position = 1;
-  U8 down = piecesList[2];
-  if (down) {
-    shifter = 0;
-    while (down) {
-      if (position & down) {
-        // start at startSpot, then right shift (8*shifter) times
-        newDown |= ((startSpot>>(8*shifter)) & mask);
-      }
-      down >>= 1;
-      shifter++;
-    }
-  }
-
-  // RIGHT
-  position = 1;
-  U8 right = piecesList[3];
-  if (right) {
-    shifter = 0;
-    while (right) {
-      if (position & right) {
-        // start at startSpot, then right shift shifter times
-        newRight |= ((startSpot>>shifter) & mask);
-      }
-      right >>= 1;
-      shifter++;
-    }
-  }
-
-  if (!(newUp & node->board.whole & mask)) newUp = 0;
-  if (!(newLeft & node->board.whole & mask)) newLeft = 0;
-  if (!(newDown & node->board.whole & mask)) newDown = 0;
-  if (!(newRight & node->board.whole & mask)) newRight = 0;
-
-  *colorSpots |= (newUp | newLeft | newDown | newRight);
-  return;
-}
-
-
 void generateChildrenDirections(StateNodePool* pool, StateNode* parent, U8* piecesList, U64 startSpot, char playerKind, U64* statesCreated) {
   U64 position;
   U64 newUp = 0, newLeft = 0, newDown = 0, newRight = 0;
@@ -534,9 +1470,10 @@ void generateChildrenDirections(StateNodePool* pool, StateNode* parent, U8* piec
       shifter++;
     }
     // Only create new child if the direction has player piece
-    if (newUp & parent->board.whole & allPlayer)
+    if (newUp & parent->board.whole & allPlayer) {
       createChild(pool, parent, newUp, startSpot, allPlayer);
       (*statesCreated)++;
+    }
   }
   
   // LEFT
@@ -552,9 +1489,10 @@ void generateChildrenDirections(StateNodePool* pool, StateNode* parent, U8* piec
       left >>= 1;
       shifter++;
     }
-    if (newLeft & parent->board.whole & allPlayer)
+    if (newLeft & parent->board.whole & allPlayer) {
       createChild(pool, parent, newLeft, startSpot, allPlayer);
       (*statesCreated)++;
+    }
   }
 
   // DOWN
@@ -570,9 +1508,10 @@ void generateChildrenDirections(StateNodePool* pool, StateNode* parent, U8* piec
       down >>= 1;
       shifter++;
     }
-    if (newDown & parent->board.whole & allPlayer)
+    if (newDown & parent->board.whole & allPlayer) {
       createChild(pool, parent, newDown, startSpot, allPlayer);
       (*statesCreated)++;
+    }
   }
 
   // RIGHT
@@ -588,9 +1527,10 @@ void generateChildrenDirections(StateNodePool* pool, StateNode* parent, U8* piec
       right >>= 1;
       shifter++;
     }
-    if (newRight & parent->board.whole & allPlayer)
+    if (newRight & parent->board.whole & allPlayer) {
       createChild(pool, parent, newRight, startSpot, allPlayer);
       (*statesCreated)++;
+    }
   }
 }
 
@@ -613,3 +1553,11 @@ void createChild(StateNodePool* pool, StateNode* parent, U64 newDirection, U64 s
   StateNodePushChild(parent, child);
 }
 
+
+void createChildFromMove(StateNodePool* pool, StateNode* parent, Move move) {
+  StateNode* child = StateNodePoolAlloc(pool);
+  child->board.whole = parent->board.whole ^ MoveMask(move);
+  MoveToText(move, child->move);
+
+  StateNodePushChild(parent, child);
+}
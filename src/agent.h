@@ -8,8 +8,202 @@
 #ifndef AGENT_H
 #define AGENT_H
 
+#include <stdio.h>
 #include "types.h"
 #include "allocators.h"
+#include "movegen.h"
+#include "transposition.h"
+#include "ordering.h"
+#include "threadpool.h"
+#include "endgame.h"
+#include "tablebase.h"
+#include "book.h"
+#include "tree.h"
+#include "mcts.h"
+#include "eval.h"
+
+#define DEFAULT_MOVE_TIME 5000 // milliseconds
+
+typedef U8 EngineKind;
+enum {
+  EngineKind_AlphaBeta, // node free negamax on a per ply move stack
+  EngineKind_Tree,      // the original search that keeps its tree in a TreePool
+  EngineKind_Ybwc,      // negamax that splits the tree between threads
+  EngineKind_Mcts,      // Monte Carlo tree search with random playouts
+};
+
+// Scores are from the point of view of the side to move. A side with no
+// move has lost, which scores ply - SCORE_WIN, so a quicker win scores
+// higher than a slower one and a longer loss higher than a quick one.
+// Evaluations stay far inside +-SCORE_WIN_MIN.
+#define SCORE_INFINITE 32000
+#define SCORE_WIN      31000
+#define SCORE_WIN_MIN  (SCORE_WIN - MAX_PLY) // any score past this is a forced result
+#define ScoreIsWin(score)  ((score) >= SCORE_WIN_MIN)
+#define ScoreIsLoss(score) ((score) <= -SCORE_WIN_MIN)
+
+#define ASPIRATION_WINDOW (4 * EVAL_SCALE) // half width of the first window around last iteration's score
+#define ASPIRATION_MIN_DEPTH 4 // shallower iterations are cheap, search them with a full window
+
+#define YBWC_MIN_SPLIT_DEPTH 3 // shallower subtrees are not worth handing out
+
+// Build with -DTELEMETRY=0 to take the search counters out of negamax()
+#ifndef TELEMETRY
+#define TELEMETRY 1
+#endif
+#if TELEMETRY
+#define TelemetryCount(counter) ((counter)++)
+#else
+#define TelemetryCount(counter) ((void)0)
+#endif
+
+// One iteration of the main thread's iterative deepening
+typedef struct SearchIteration SearchIteration;
+struct SearchIteration {
+  I32 depth;
+  Bool completed; // false for the last one if the clock ran out during it
+  U64 nodes; // the main thread's, aspiration re-searches included
+  U64 time;  // nanoseconds
+};
+
+/*
+ * Young brothers wait: once the first move of a node has been searched the
+ * rest of its moves are put up for grabs in a SplitPoint. The owner and any
+ * thread that steals the split point take moves from nextMove until none
+ * are left. A cutoff found by anyone sets cutoff, and every thread working
+ * below this split point (or one of its children) unwinds.
+ */
+typedef struct SearchContext SearchContext;
+typedef struct SplitPoint SplitPoint;
+struct SplitPoint {
+  pthread_mutex_t lock;
+  SplitPoint *parent; // the split point the owner was working under
+  SearchContext *owner;
+  BitBoard board;
+  U64 key;
+  I32 ply;
+  I32 depth;
+  PlayerKind player; // to move at the split point
+  MoveList *moves; // the owner's list for this ply
+  U32 nextMove;    // taken with an atomic add
+  U32 workers;     // threads inside, the owner included
+  Bool finished;   // no one new may join
+  Bool cutoff;
+  // everything below is only touched with lock held
+  I32 alpha;
+  I32 beta;
+  I32 bestEval;
+  Move bestMove;
+};
+
+// Everything the node free search needs, indexed by ply
+struct SearchContext {
+  BitBoard board;
+  U64 key; // Zobrist key of board and the side to move
+  TranspositionTable *tt;
+  U64 nodes;
+  U64 ttProbes;
+  U64 ttHits;
+  U64 tbHits; // positions answered by the tablebase
+  U64 expanded; // nodes that generated their moves, counted with TelemetryCount()
+  U64 cutoffs;
+  U64 firstMoveCutoffs; // cutoffs by the first move searched, how good the ordering is
+  U32 iterationCount; // only filled in by the main thread
+  SearchIteration iterations[MAX_PLY];
+  U64 deadline; // TimerNow() value the search has to stop at
+  U64 nodeLimit; // nodes the search has to stop at
+  Bool *abort;  // shared by every thread, set when the search is over
+  Bool stopped;
+  Bool followPv; // still on the path of the last iteration's principal variation
+  U8 pvLength[MAX_PLY];
+  U8 prevPvLength;
+  Move pv[MAX_PLY][MAX_PLY]; // pv[ply] is the best line found from ply on
+  Move prevPv[MAX_PLY];
+  MoveOrdering ordering;
+  MoveList moves[MAX_PLY];
+  I32 rootScores[MAX_MOVES]; // of the last completed iteration, moves[0] is sorted to match
+  I32 completedDepth;
+
+  // Only used by the YBWC engine. splits is this thread's work stealing
+  // deque: the owner pushes and pops the bottom as it recurses and other
+  // threads look for work from the top, where the biggest subtrees are.
+  Bool splitting;
+  SplitPoint *splitPoint; // innermost split point we are working for
+  pthread_mutex_t splitLock;
+  U32 splitCount;
+  SplitPoint *splits[MAX_PLY];
+};
+
+// One per search thread, nothing in here is shared so nothing needs a lock
+typedef struct SearchThread SearchThread;
+struct SearchThread {
+  U32 index; // 0 is the main thread
+  Arena *arena;
+  SearchContext *ctx;
+};
+
+typedef struct SearchResult SearchResult;
+struct SearchResult {
+  MoveList rootMoves; // best first
+  I32 scores[MAX_MOVES]; // for the agent, only the first is exact, the rest are upper bounds
+  I32 depth;
+  U64 nodes;
+  U64 ttProbes;
+  U64 ttHits;
+  U64 tbHits;
+  U64 expanded;
+  U64 cutoffs;
+  U64 firstMoveCutoffs;
+  U32 iterationCount;
+  SearchIteration iterations[MAX_PLY];
+  U64 time; // nanoseconds
+  Move reply; // the opponent's expected answer to rootMoves.moves[0], MOVE_NONE if we have no guess
+};
+
+typedef struct Agent Agent;
+struct Agent {
+  PlayerKind player;
+  EngineKind engine;
+  TreePool *tree; // only the tree engine needs one
+  TreeIndex treeRoot; // tree engine: the node our last move was from, its subtree is reused
+  U32 treePlayed; // tree engine: the child of treeRoot we played
+  MctsTree *mcts; // only the MCTS engine needs one
+  Arena *arena; // the one given to AgentThreadsInit(), holds the threads and usually the table
+  TranspositionTable *tt; // kept between moves, shared by every thread
+  int depth; // depth iterative deepening starts at
+  int maxDepth; // stop after completing this depth, 0 for no limit
+  U64 maxNodes; // stop once the main thread has searched this many nodes, 0 for no limit
+  Bool solve; // keep deepening with only one move too, until the result is forced
+  U64 moveTime; // milliseconds we may think for each move
+  FILE *telemetry; // a JSON line per move goes here, NULL for none
+  Bool printMemory; // the allocators' counts to stderr after every searched move
+  U32 movesMade;
+  Endgame *endgame; // NULL to always search
+  U32 endgamePieces; // try the endgame solver when fewer pieces than this can move
+
+  // Lazy SMP: every thread runs iterative deepening on the same root and
+  // they only talk through the transposition table.
+  // YBWC: only the main thread iterates, helpers steal split points.
+  U32 threadCount;
+  SearchThread *threads;  // threadCount of them
+  ThreadPool *threadPool; // threadCount - 1 helpers, NULL with one thread
+  Bool abort;
+  BitBoard searchBoard;
+  U64 searchStart; // with pondering, when our clock started
+
+  // Pondering: after our move the search goes on in ponderThread from the
+  // board we expect after the opponent's reply, with no deadline, while
+  // main.c waits for their move. If they play it the search carries on with
+  // the clock running, otherwise it is stopped and only the table is kept.
+  Bool ponder; // think on the opponent's time
+  Move ponderMove; // reply expected after our last move, MOVE_NONE if none
+  BitBoard ponderBoard;
+  Bool ponderRunning; // ponderThread has to be joined
+  pthread_t ponderThread;
+  SearchResult ponderResult;
+  pthread_mutex_t ponderLock; // guards pondering, searchStart and the main thread's deadline
+  Bool pondering; // the ponder search has no deadline yet
+};
 
 // REMOVE THIS AFTER DEMO
 U64 getUpMove(BitBoard board, char player);
@@ -17,12 +211,19 @@ U64 getUpMove(BitBoard board, char player);
 U64 getPlayerEmptySpace(BitBoard board, char player);
 void getMovablePieces(U8* pList, U64 jump, BitBoard board, char player); 
 StateNode* StateNodeGenerateChildren(StateNodePool *pool, StateNode *parent, char playerKind, U64* statesCreated);
+StateNode* StateNodeGenerateChildrenReference(StateNodePool *pool, StateNode *parent, char playerKind, U64* statesCreated);
+U64 PerftReference(StateNodePool *pool, StateNode *node, char playerKind, U32 depth);
 U64 StateNodeCountChildren(StateNode *node);
 void StateNodePushChild(StateNode *parent, StateNode *child);
-void StateNodeCalcCost(StateNode* node);
-void agentMove(U8 agentPlayer, BitBoard* board, StateNodePool *pool, int depth);
+void TreeNodeCalcCost(TreeNode* node, const Mobility *mobility);
+I32 MobilityEvaluate(const Mobility *mobility);
+void AgentThreadsInit(Agent *agent, Arena *arena, U32 threadCount);
+void AgentThreadsDeinit(Agent *agent);
+void AgentSearch(Agent *agent, BitBoard board, SearchResult *result);
+void AgentPonderStart(Agent *agent, BitBoard board); // board is the one after our move
+void AgentPonderStop(Agent *agent, BitBoard board); // board is the one after the opponent's move
+void agentMove(Agent *agent, BitBoard* board);
 
-// For the minimax functions
 // Max and Min functions
 static inline int max(int x, int y) {
   return x > y ? x : y;
@@ -31,8 +232,19 @@ static inline int max(int x, int y) {
 static inline int min(int x, int y) {
   return x < y ? x : y;
 }
-// Minimax Algorithm functions
-I32 minimax(StateNodePool *pool, StateNode* node, I32 depth, I32 alpha, I32 beta, I32 maximizingPlayer, U64* statesCreated);
+// What negamaxTree() keeps track of besides the tree
+typedef struct TreeSearch TreeSearch;
+struct TreeSearch {
+  TreePool *pool;
+  U64 deadline; // TimerNow() time, looked at every so many nodes
+  U64 nodes;
+  U64 statesCreated;
+  Bool stopped; // the deadline passed, the iteration it happened in does not count
+};
+
+// Negamax functions, both return the score for player
+I32 negamaxTree(TreeSearch *search, TreeIndex index, I32 ply, I32 depth, I32 alpha, I32 beta, PlayerKind player);
+I32 negamax(SearchContext *ctx, I32 ply, I32 depth, I32 alpha, I32 beta, PlayerKind player);
 
 
 #endif
@@ -1,19 +1,62 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include "allocators.h"
 
 
 
+static inline U64 arenaRoundUp(U64 x, U64 to) {
+  return (x + to - 1) / to * to;
+}
+
+// Past the first ARENA_COMMIT_SIZE, big reservations commit whole huge
+// pages so the kernel can back them with one. The first stays small so an
+// arena that is hardly used does not cost a huge page.
+static inline U64 arenaCommitStep(U64 reserved) {
+  return (reserved >= ARENA_HUGE_PAGE_MIN) ? ARENA_HUGE_PAGE : ARENA_COMMIT_SIZE;
+}
+
+
 Arena *ArenaInit(U64 capacity) {
   capacity = (capacity < Kilobyte(4))? Kilobyte(4):capacity;
-  void *ptr = malloc(capacity);
-  Arena *arena = ptr;
+  U64 step = arenaCommitStep(capacity);
+  U64 reserved = arenaRoundUp(capacity, step);
+
+  // Huge pages have to start on a huge page boundary, so map one more and
+  // trim the ends off
+  U64 slack = (step == ARENA_HUGE_PAGE) ? ARENA_HUGE_PAGE : 0;
+  char *mapped = mmap(NULL, reserved + slack, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapped == MAP_FAILED) {
+    perror("ArenaInit");
+    return NULL;
+  }
+  char *base = mapped;
+  if (slack) {
+    base = (char*)arenaRoundUp((U64)mapped, ARENA_HUGE_PAGE);
+    if (base > mapped) munmap(mapped, base - mapped);
+    if (mapped + slack > base) munmap(base + reserved, mapped + slack - base);
+#ifdef MADV_HUGEPAGE
+    madvise(base, reserved, MADV_HUGEPAGE);
+#endif
+  }
+
+  if (mprotect(base, ARENA_COMMIT_SIZE, PROT_READ | PROT_WRITE)) {
+    perror("ArenaInit");
+    munmap(base, reserved);
+    return NULL;
+  }
+
+  Arena *arena = (Arena*)base;
   arena->buff = (char*)&arena[1];
   arena->align = 8;
   arena->next = NULL;
+  arena->current = arena;
   arena->pos = 0;
-  arena->cap = capacity;
+  arena->cap = reserved - sizeof(Arena);
+  arena->committed = ARENA_COMMIT_SIZE - sizeof(Arena);
+  arena->reserved = reserved;
+  arena->stats = (AllocStats){ .chunks = 1 };
   
   return arena;
 }
@@ -23,7 +66,7 @@ void ArenaDeinit(Arena *arena) {
   while (node) {
     Arena *next = node->next;
 
-    free(node);
+    munmap(node, node->reserved);
 
     node = next;
   }
@@ -31,22 +74,48 @@ void ArenaDeinit(Arena *arena) {
 }
 
 
+// Makes buff usable up to end, end is at most cap
+static Bool arenaCommit(Arena *arena, U64 end) {
+  U64 step = arenaCommitStep(arena->reserved);
+  U64 committed = arenaRoundUp(sizeof(Arena) + end, step) - sizeof(Arena);
+  if (committed > arena->cap) committed = arena->cap;
+
+  if (mprotect(arena->buff + arena->committed, committed - arena->committed, PROT_READ | PROT_WRITE)) {
+    perror("ArenaPush");
+    return Bool_False;
+  }
+  arena->committed = committed;
+  return Bool_True;
+}
+
+
 void *ArenaPushNoZero(Arena *arena, U64 size) {
-  while (arena->pos + size > arena->cap) {
-    if (!arena->next) {
-      arena->next = ArenaInit(ARENA_DEFAULT_SIZE);
+  Arena *block = arena->current;
+  U64 pos = arenaRoundUp(block->pos, arena->align);
+
+  // Only the arenas after current are looked at, and only when it is full
+  while (pos + size > block->cap) {
+    if (!block->next) {
+      U64 capacity = sizeof(Arena) + size + arena->align;
+      block->next = ArenaInit((capacity < ARENA_DEFAULT_SIZE) ? ARENA_DEFAULT_SIZE : capacity);
+      if (!block->next) return NULL;
+      arena->stats.chunks++;
     }
 
-    arena = arena->next;
+    block = block->next;
+    pos = arenaRoundUp(block->pos, arena->align);
   }
 
-  arena->pos = ((arena->pos + arena->align - 1) / arena->align) * arena->align;
+  if (pos + size > block->committed && !arenaCommit(block, pos + size)) return NULL;
 
-  void *result = arena->buff + arena->pos;
+  arena->current = block;
+  block->pos = pos + size;
 
-  arena->pos += size;
+  arena->stats.allocs++;
+  arena->stats.bytes += size;
+  if (arena->stats.bytes > arena->stats.peakBytes) arena->stats.peakBytes = arena->stats.bytes;
 
-  return result;
+  return block->buff + pos;
 }
 
 
@@ -57,50 +126,78 @@ void *ArenaPush(Arena *arena, U64 size) {
 }
 
 
+/*
+ * Everything past the first commit goes back to the system. mprotect()
+ * alone would keep the pages, MADV_DONTNEED is what frees them.
+ */
 void ArenaReset(Arena *arena) {
   Arena *node = arena;
   while (node) {
     Arena *next = node->next;
 
     node->pos = 0;
+    U64 keep = ARENA_COMMIT_SIZE - sizeof(Arena);
+    if (node->committed > keep) {
+      madvise(node->buff + keep, node->committed - keep, MADV_DONTNEED);
+      mprotect(node->buff + keep, node->committed - keep, PROT_NONE);
+      node->committed = keep;
+    }
 
     node = next;
   }
-  
+
+  arena->current = arena;
+  arena->stats.bytes = 0;
 }
 
 
 TempArena TempArenaInit(Arena *backing_arena) {
   return (TempArena){
     .arena = backing_arena,
-    .pos = backing_arena->pos,
+    .current = backing_arena->current,
+    .pos = backing_arena->current->pos,
     .align = backing_arena->align,
+    .bytes = backing_arena->stats.bytes,
   };
 }
 
 
 void TempArenaDeinit(TempArena temp_arena) {
-  temp_arena.arena->pos = temp_arena.pos;
+  Arena *node = temp_arena.current->next;
+  while (node) {
+    node->pos = 0;
+    node = node->next;
+  }
+
+  temp_arena.current->pos = temp_arena.pos;
+  temp_arena.arena->current = temp_arena.current;
   temp_arena.arena->align = temp_arena.align;
+  temp_arena.arena->stats.bytes = temp_arena.bytes;
 }
 
 StateNodePool *StateNodePoolInit(Arena *backingArena) {
-  StateNodePool *pool = ArenaPushNoZero(backingArena, sizeof(StateNodePool));
+  StateNodePool *pool = ArenaPush(backingArena, sizeof(StateNodePool));
   pool->arena = backingArena;
-  pool->freeList = NULL;
   return pool;
 }
 
 StateNode *StateNodePoolAlloc(StateNodePool *pool) {
+  StateNode *node;
   if (pool->freeList) {
-    StateNode *node = pool->freeList;
+    node = pool->freeList;
     pool->freeList = pool->freeList->next;
     memset(node, 0, sizeof(StateNode)); // memzero
-    return node;
+    pool->stats.freeListHits++;
 
   } else {
-    return ArenaPush(pool->arena, sizeof(StateNode));
+    node = ArenaPush(pool->arena, sizeof(StateNode));
+    pool->stats.chunks++;
   }
+
+  pool->stats.allocs++;
+  U64 live = pool->stats.allocs - pool->stats.frees;
+  if (live * sizeof(StateNode) > pool->stats.peakBytes) pool->stats.peakBytes = live * sizeof(StateNode);
+  return node;
 }
 
 void StateNodePoolFree(StateNodePool *pool, StateNode *node) {
@@ -112,4 +209,18 @@ void StateNodePoolFree(StateNodePool *pool, StateNode *node) {
 
   node->next = pool->freeList;
   pool->freeList = node;
+  pool->stats.frees++;
+}
+
+AllocStats StateNodePoolStats(StateNodePool *pool) {
+  AllocStats stats = pool->stats;
+  stats.bytes = (stats.allocs - stats.frees) * sizeof(StateNode);
+  return stats;
+}
+
+
+void AllocStatsPrint(FILE *fp, const char *name, const AllocStats *stats) {
+  fprintf(fp, "%-12s %10llu allocs %10llu frees %10llu free list hits %6llu chunks %10.1f KB in use %10.1f KB peak\n",
+         name, stats->allocs, stats->frees, stats->freeListHits, stats->chunks,
+         stats->bytes / 1024.0, stats->peakBytes / 1024.0);
 }
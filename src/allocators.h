@@ -2,6 +2,14 @@
   USAGE: 
     The files arena.h and arena.c are for memory management using 
     only arena allocators.
+
+    ArenaInit() only reserves address space, pages are committed
+    ARENA_COMMIT_SIZE at a time as pushes reach them and the kernel
+    only backs them once they are touched. Big reservations are asked
+    to use transparent huge pages. Once a reservation is full another
+    one is chained on and current points at it, so a push never walks
+    the chain. ArenaReset() hands everything past the first commit back
+    to the system.
   
   RESOURCES:
     if you are completely new to the concept here are some resources
@@ -18,12 +26,26 @@
 
 #include "types.h"
 
-#define Kilobyte(x) ((x)<<10)
-#define Megabyte(x) ((x)<<20)
+#define Kilobyte(x) (((U64)(x))<<10)
+#define Megabyte(x) (((U64)(x))<<20)
 #define Gigabyte(x) (((U64)(x))<<30)
 
 #define ARENA_DEFAULT_SIZE  Megabyte(1)
-
+#define ARENA_COMMIT_SIZE   Kilobyte(64) // committed at a time, a multiple of the page size
+#define ARENA_HUGE_PAGE     Megabyte(2)
+#define ARENA_HUGE_PAGE_MIN Megabyte(256) // smaller reservations stay on normal pages, touching a byte of a huge page costs all of it
+
+
+// Counted by the owning thread, so only read them while it is idle
+typedef struct AllocStats AllocStats;
+struct AllocStats {
+  U64 allocs;
+  U64 frees;
+  U64 freeListHits; // allocations a free list gave back
+  U64 chunks;       // pieces taken from the memory behind it, reservations for an arena
+  U64 bytes;        // in use right now
+  U64 peakBytes;
+};
 
 typedef struct Arena Arena;
 struct Arena {
@@ -31,20 +53,27 @@ struct Arena {
   U64 pos;
   U64 cap;
   U64 align;
+  U64 committed; // bytes of buff that may be touched
+  U64 reserved;  // bytes mapped, this header included
   Arena *next;
+  Arena *current; // only kept up to date in the first arena of a chain
+  AllocStats stats; // for the whole chain, kept in the first arena
 };
 
 typedef struct TempArena TempArena;
 struct TempArena {
   Arena *arena;
+  Arena *current;
   U64 pos;
   U64 align;
+  U64 bytes;
 };
 
 typedef struct StateNodePool StateNodePool;
 struct StateNodePool {
   Arena *arena;
   StateNode *freeList;
+  AllocStats stats;
 };
 
 
@@ -53,7 +82,10 @@ Arena *ArenaInit(U64 capacity); // Initalize a Arena with a certain an inital bu
 void ArenaDeinit(Arena *arena); // Free all the buffers in a arena
 void *ArenaPushNoZero(Arena *arena, U64 size); // Get a memory region with no zero initialization
 void *ArenaPush(Arena *arena, U64 size); // get a memory region with zero initalization
-void ArenaReset(Arena *arena); // reset all the positions in the linked list of arena's to zero
+void ArenaReset(Arena *arena); // reset all the positions in the linked list of arena's to zero and give back their pages
+static inline AllocStats ArenaStats(Arena *arena) {
+  return arena->stats;
+}
 static inline void ArenaSetAutoAlign(Arena *arena, U64 align) { // We have default alignment of 8
   arena->align = align;
 }
@@ -64,6 +96,9 @@ void TempArenaDeinit(TempArena temp_arena); // end a temporary arena
 StateNodePool *StateNodePoolInit(Arena *backingArena); // we dont need deinit cause when we deinit the arena the pool will go with it
 StateNode *StateNodePoolAlloc(StateNodePool *pool);
 void StateNodePoolFree(StateNodePool *, StateNode *node);
+AllocStats StateNodePoolStats(StateNodePool *pool);
+
+void AllocStatsPrint(FILE *fp, const char *name, const AllocStats *stats);
 
 
 
@@ -189,6 +189,7 @@ void mainInput(BitBoard* board, char player) {
   U64 allPlayerBoard = (player == PlayerKind_White) ? allWhite : allBlack;
   
   printf("Your move: ");
+  fflush(stdout); // whoever reads us through a pipe needs everything before we wait on them
 
   // First move
   if (!((board->whole & allPlayerBoard) ^ allPlayerBoard)) {
@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "book.h"
+#include "types.h"
+#include "movegen.h"
+#include "boardio.h"
+
+Book book;
+
+
+Bool BookLoad(const char *path) {
+  BookUnload();
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return Bool_False;
+  struct stat st;
+  if (fstat(fd, &st) || (U64)st.st_size < sizeof(BookHeader)) {
+    close(fd);
+    return Bool_False;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps the file open
+  if (map == MAP_FAILED) return Bool_False;
+
+  const BookHeader *header = map;
+  if (memcmp(header->magic, BOOK_MAGIC, sizeof(header->magic)) || header->version != BOOK_VERSION ||
+      sizeof(BookHeader) + header->count * sizeof(BookEntry) != (U64)st.st_size) {
+    munmap(map, st.st_size);
+    return Bool_False;
+  }
+
+  book.map = map;
+  book.size = st.st_size;
+  book.entries = (const BookEntry *)(header + 1);
+  book.count = header->count;
+  return Bool_True;
+}
+
+
+void BookUnload(void) {
+  if (book.map) munmap((void *)book.map, book.size);
+  memset(&book, 0, sizeof(book));
+}
+
+
+int BookEntryCompare(const void *a, const void *b) {
+  const BookEntry *x = a, *y = b;
+  if (x->board != y->board) return (x->board < y->board) ? -1 : 1;
+  if (x->player != y->player) return (x->player < y->player) ? -1 : 1;
+  return (int)y->weight - (int)x->weight;
+}
+
+
+U32 OpeningRemovals(BitBoard board, PlayerKind player, MoveList *list) {
+  list->count = 0;
+  U64 squares = PlayerSquares(player);
+  if ((board.whole & squares) != squares) return 0;
+
+  // The centre stones next to where black's removal left a hole
+  char *texts[2] = { "D5", "E4" };
+  if (player == PlayerKind_White) {
+    texts[0] = "D4";
+    texts[1] = "E5";
+  }
+  for (U32 i = 0; i < 2; i++) {
+    U8 square = IndexFromCoord(CoordFromInput(texts[i]));
+    list->moves[list->count++] = MoveRemoval(square);
+  }
+  return list->count;
+}
+
+
+/*
+ * Finds the board's entries with a binary search and picks one at random,
+ * the better moves more often. A move that is not legal here is never
+ * played, in case the book was built with other rules.
+ */
+Bool BookProbe(BitBoard board, PlayerKind player, Move *move) {
+  if (!book.map) return Bool_False;
+
+  BookEntry key = { .board = board.whole, .player = player, .weight = 0xFFFF };
+  U64 low = 0, high = book.count;
+  while (low < high) {
+    U64 middle = low + (high - low) / 2;
+    if (BookEntryCompare(&book.entries[middle], &key) < 0) low = middle + 1;
+    else high = middle;
+  }
+
+  U32 total = 0;
+  U64 end = low;
+  while (end < book.count && book.entries[end].board == board.whole && book.entries[end].player == player) {
+    total += book.entries[end++].weight;
+  }
+  if (!total) return Bool_False;
+
+  U32 pick = rand() % total;
+  U64 chosen = low;
+  while (pick >= book.entries[chosen].weight) pick -= book.entries[chosen++].weight;
+  *move = book.entries[chosen].move;
+
+  MoveList list;
+  if (!OpeningRemovals(board, player, &list)) GenerateMoves(board, player, &list);
+  for (U32 i = 0; i < list.count; i++) {
+    if (list.moves[i] == *move) return Bool_True;
+  }
+  return Bool_False;
+}
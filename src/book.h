@@ -0,0 +1,74 @@
+/*
+  USAGE:
+    The files book.h and book.c are for the opening book: the moves deep
+    searches found for the positions every game starts with, so the agent
+    can play them without searching. bookgen.c builds it offline.
+
+    The file is a BookHeader followed by BookEntries sorted by board, then
+    side to move, then weight (biggest first). A board is its own key, all
+    64 squares fit in one U64, so two positions never share entries. The
+    file is mapped read only and looked up with a binary search:
+
+    BookLoad("konane.book"); // once at startup, false if there is none
+    Move move;
+    if (BookProbe(board, player, &move)) ... // picked at random by weight
+    BookUnload();
+
+    The two stones taken off at the start of a game are moves too, with
+    the same square as from and to. MoveMask() is wrong for them.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef BOOK_H
+#define BOOK_H
+
+#include "types.h"
+#include "movegen.h"
+
+#define BOOK_MAGIC "KONANEBK"
+#define BOOK_VERSION 1 // bump whenever the layout or the keys change
+#define BOOK_DEFAULT_PATH "konane.book"
+
+#define MoveRemoval(square) MoveMake(square, square)
+#define MoveIsRemoval(move) (MoveFrom(move) == MoveTo(move))
+
+typedef struct BookHeader BookHeader;
+struct BookHeader {
+  char magic[8];
+  U32 version;
+  U32 unused;
+  U64 count; // entries after the header
+};
+
+typedef struct BookEntry BookEntry;
+struct BookEntry {
+  U64 board;
+  PlayerKind player; // to move
+  U8 unused;
+  Move move;
+  U16 weight; // how often to play it next to the board's other moves
+  U16 unused2;
+};
+
+typedef struct Book Book;
+struct Book {
+  const U8 *map; // NULL when nothing is loaded
+  U64 size;
+  const BookEntry *entries;
+  U64 count;
+};
+
+extern Book book;
+
+Bool BookLoad(const char *path);
+void BookUnload(void);
+Bool BookProbe(BitBoard board, PlayerKind player, Move *move); // false if the book does not know the board
+int BookEntryCompare(const void *a, const void *b); // the order entries are stored in, for qsort()
+
+// The stones player may take off if the game has not started for them yet,
+// 0 once they have
+U32 OpeningRemovals(BitBoard board, PlayerKind player, MoveList *list);
+
+#endif
@@ -0,0 +1,248 @@
+/*
+  USAGE:
+    bookgen.c is the offline builder for the opening book (see book.h).
+    Like tablegen.c it is its own program:
+
+    make book
+    ./bookgen.exe [file] [--plies N] [--depth D] [--margin M] [--threads T] [--hash MB]
+
+    A book is built for each side. Where the book's side is to move every
+    move is scored with a search of the position it leads to, the moves
+    within margin of the best go in the book and only those are followed.
+    Where the other side is to move every reply is followed, the book has
+    to know what to do whatever they play. This stops plies moves into the
+    game, counting the two stones taken off at the start.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "transposition.h"
+#include "agent.h"
+#include "book.h"
+#include "timer.h"
+
+#define BOOK_DEFAULT_PLIES 8
+#define BOOK_DEFAULT_DEPTH 10 // each move is scored with a search this deep
+#define BOOK_DEFAULT_MARGIN (2 * EVAL_SCALE) // moves this much worse than the best still go in, less often
+#define BOOKGEN_TABLE_SIZE (1 << 20) // positions remembered, a power of two
+#define BOOKGEN_MAX_ENTRIES (1 << 20)
+
+// What is known about a position, a board is only searched once
+typedef struct BookgenPosition BookgenPosition;
+struct BookgenPosition {
+  U64 board;
+  PlayerKind player;
+  Bool used;
+  Bool scored;
+  Bool expanded[2]; // by the side of the book it was followed for
+  I32 score; // for player
+};
+
+typedef struct Bookgen Bookgen;
+struct Bookgen {
+  Agent agent;
+  I32 plies;
+  I32 depth;
+  I32 margin;
+  BookgenPosition *positions;
+  BookEntry *entries;
+  U64 entryCount;
+  U64 searches;
+  U64 start;
+};
+
+
+static inline U64 hashMix(U64 x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+
+static BookgenPosition *bookgenFind(Bookgen *gen, U64 board, PlayerKind player) {
+  U32 slot = hashMix(board ^ player) & (BOOKGEN_TABLE_SIZE - 1);
+  while (gen->positions[slot].used &&
+         (gen->positions[slot].board != board || gen->positions[slot].player != player)) {
+    slot = (slot + 1) & (BOOKGEN_TABLE_SIZE - 1);
+  }
+
+  BookgenPosition *position = &gen->positions[slot];
+  if (!position->used) {
+    position->used = Bool_True;
+    position->board = board;
+    position->player = player;
+  }
+  return position;
+}
+
+
+// The moves of a position, the stones taken off at the start included
+static U32 bookgenMoves(U64 board, PlayerKind player, MoveList *list) {
+  BitBoard bitBoard = { .whole = board };
+  if (OpeningRemovals(bitBoard, player, list)) return list->count;
+  return GenerateMoves(bitBoard, player, list);
+}
+
+static inline U64 bookgenPlay(U64 board, Move move) {
+  return (MoveIsRemoval(move)) ? board ^ (1llu << MoveFrom(move)) : board ^ MoveMask(move);
+}
+
+
+static I32 bookgenScoreMoves(Bookgen *gen, U64 board, PlayerKind player, MoveList *list, I32 *scores);
+
+/*
+ * The score of a position for the side to move. Before both stones are off
+ * the search can not start, so it is the best of the moves it has.
+ */
+static I32 bookgenScore(Bookgen *gen, U64 board, PlayerKind player) {
+  BookgenPosition *position = bookgenFind(gen, board, player);
+  if (position->scored) return position->score;
+
+  MoveList list;
+  BitBoard bitBoard = { .whole = board };
+  I32 scores[MAX_MOVES];
+  I32 score;
+  if (OpeningRemovals(bitBoard, player, &list)) {
+    score = bookgenScoreMoves(gen, board, player, &list, scores);
+  } else if (!GenerateMoves(bitBoard, player, &list)) {
+    score = -SCORE_WIN;
+  } else {
+    SearchResult result;
+    gen->agent.player = player;
+    AgentSearch(&gen->agent, bitBoard, &result);
+    score = result.scores[0];
+    gen->searches++;
+  }
+
+  position->scored = Bool_True;
+  position->score = score;
+  return score;
+}
+
+
+// Scores every move in list from the positions they lead to, returns the best
+static I32 bookgenScoreMoves(Bookgen *gen, U64 board, PlayerKind player, MoveList *list, I32 *scores) {
+  I32 best = -SCORE_INFINITE;
+  for (U32 i = 0; i < list->count; i++) {
+    I32 score = -bookgenScore(gen, bookgenPlay(board, list->moves[i]), PlayerOpponent(player));
+    // one ply further from the result than it was from the child
+    if (ScoreIsWin(score)) score--;
+    else if (ScoreIsLoss(score)) score++;
+    scores[i] = score;
+    best = max(best, score);
+  }
+  return best;
+}
+
+
+static void bookgenExpand(Bookgen *gen, U64 board, PlayerKind player, I32 ply, PlayerKind side) {
+  if (ply >= gen->plies) return;
+  BookgenPosition *position = bookgenFind(gen, board, player);
+  if (position->expanded[side]) return;
+  position->expanded[side] = Bool_True;
+
+  MoveList list;
+  if (!bookgenMoves(board, player, &list)) return;
+
+  if (player != side) {
+    for (U32 i = 0; i < list.count; i++) bookgenExpand(gen, bookgenPlay(board, list.moves[i]), side, ply + 1, side);
+    return;
+  }
+
+  I32 scores[MAX_MOVES];
+  I32 best = bookgenScoreMoves(gen, board, player, &list, scores);
+  for (U32 i = 0; i < list.count; i++) {
+    if (scores[i] < best - gen->margin || gen->entryCount >= BOOKGEN_MAX_ENTRIES) continue;
+    gen->entries[gen->entryCount++] = (BookEntry){
+      .board = board,
+      .player = player,
+      .move = list.moves[i],
+      .weight = gen->margin + 1 - (best - scores[i]),
+    };
+    bookgenExpand(gen, bookgenPlay(board, list.moves[i]), PlayerOpponent(player), ply + 1, side);
+  }
+
+  if (ply <= 2) {
+    printf("%llu entries, %llu searches, %.1f seconds\n", gen->entryCount, gen->searches,
+           TimerSeconds(TimerNow() - gen->start));
+  }
+}
+
+
+int main(int argc, char **argv) {
+  const char *path = BOOK_DEFAULT_PATH;
+  U64 hashMegabytes = TT_DEFAULT_MEGABYTES;
+  U32 threads = 1;
+  Bookgen gen = {
+    .plies = BOOK_DEFAULT_PLIES,
+    .depth = BOOK_DEFAULT_DEPTH,
+    .margin = BOOK_DEFAULT_MARGIN,
+  };
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--plies") && i + 1 < argc) gen.plies = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--depth") && i + 1 < argc) gen.depth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--margin") && i + 1 < argc) gen.margin = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--hash") && i + 1 < argc) hashMegabytes = strtoull(argv[++i], NULL, 10);
+    else if (i == 1 && argv[i][0] != '-') path = argv[i];
+    else {
+      printf("usage: bookgen.exe [file] [--plies N] [--depth D] [--margin M] [--threads T] [--hash MB]\n");
+      return -1;
+    }
+  }
+  if (gen.depth < 1) gen.depth = 1;
+  if (!hashMegabytes) hashMegabytes = 1;
+
+  ZobristInit();
+  Arena *arena = ArenaInit(Megabyte(hashMegabytes) + BOOKGEN_TABLE_SIZE * sizeof(BookgenPosition) +
+                           BOOKGEN_MAX_ENTRIES * sizeof(BookEntry) + Megabyte(1));
+  gen.positions = ArenaPush(arena, BOOKGEN_TABLE_SIZE * sizeof(BookgenPosition));
+  gen.entries = ArenaPushNoZero(arena, BOOKGEN_MAX_ENTRIES * sizeof(BookEntry));
+  gen.agent = (Agent){
+    .engine = EngineKind_AlphaBeta,
+    .tt = TTInit(arena, hashMegabytes),
+    .depth = 1,
+    .maxDepth = gen.depth,
+    .moveTime = 1000llu * 60 * 60,
+  };
+  AgentThreadsInit(&gen.agent, arena, threads);
+
+  // Black takes the first stone off a full board
+  gen.start = TimerNow();
+  bookgenExpand(&gen, ~0llu, PlayerKind_Black, 0, PlayerKind_Black);
+  bookgenExpand(&gen, ~0llu, PlayerKind_Black, 0, PlayerKind_White);
+  AgentThreadsDeinit(&gen.agent);
+
+  qsort(gen.entries, gen.entryCount, sizeof(BookEntry), BookEntryCompare);
+  BookHeader header = {
+    .magic = BOOK_MAGIC,
+    .version = BOOK_VERSION,
+    .count = gen.entryCount,
+  };
+
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    printf("Could not open %s\n", path);
+    return -1;
+  }
+  Bool written = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                 fwrite(gen.entries, sizeof(BookEntry), gen.entryCount, fp) == gen.entryCount;
+  written = !fclose(fp) && written;
+  if (!written) {
+    printf("Could not write %s\n", path);
+    return -1;
+  }
+  printf("\nWrote %llu entries to %s after %llu searches in %.1f seconds\n", gen.entryCount, path,
+         gen.searches, TimerSeconds(TimerNow() - gen.start));
+
+  ArenaDeinit(arena);
+  return 0;
+}
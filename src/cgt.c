@@ -0,0 +1,323 @@
+#include <string.h>
+#include "cgt.h"
+#include "types.h"
+#include "allocators.h"
+
+#define GAME_NONE 0xFFFFFFFFu
+#define OPTIONS_PER_GAME 8 // room in the option pool per game on average
+
+
+static inline U64 hashMix(U64 x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+
+static U32 powerOfTwoAtLeast(U32 x) {
+  U32 result = 1;
+  while (result < x) result *= 2;
+  return result;
+}
+
+
+GameStore *GameStoreInit(Arena *arena, U32 capacity) {
+  GameStore *games = ArenaPush(arena, sizeof(GameStore));
+  games->gameCap = capacity;
+  games->games = ArenaPushNoZero(arena, capacity * sizeof(Game));
+  games->optionCap = capacity * OPTIONS_PER_GAME;
+  games->options = ArenaPushNoZero(arena, games->optionCap * sizeof(GameId));
+
+  U32 internSize = powerOfTwoAtLeast(capacity * 2);
+  games->intern = ArenaPushNoZero(arena, internSize * sizeof(GameId));
+  games->internMask = internSize - 1;
+
+  U32 leqSize = powerOfTwoAtLeast(capacity * 4);
+  games->leqKeys = ArenaPushNoZero(arena, leqSize * sizeof(U64));
+  games->leqValues = ArenaPushNoZero(arena, leqSize * sizeof(U8));
+  games->leqMask = leqSize - 1;
+
+  U32 sumSize = powerOfTwoAtLeast(capacity * 2);
+  games->sumKeys = ArenaPushNoZero(arena, sumSize * sizeof(U64));
+  games->sumValues = ArenaPushNoZero(arena, sumSize * sizeof(GameId));
+  games->sumMask = sumSize - 1;
+
+  GameStoreClear(games);
+  return games;
+}
+
+
+static GameId internForm(GameStore *games, const GameId *left, U32 leftCount, const GameId *right, U32 rightCount);
+
+void GameStoreClear(GameStore *games) {
+  memset(games->intern, 0xFF, (games->internMask + 1) * sizeof(GameId));
+  memset(games->leqKeys, 0xFF, (games->leqMask + 1) * sizeof(U64));
+  memset(games->sumKeys, 0xFF, (games->sumMask + 1) * sizeof(U64));
+  games->gameCount = 0;
+  games->optionCount = 0;
+  games->leqCount = 0;
+  games->sumCount = 0;
+  games->full = Bool_False;
+
+  // zero is the first game made, so it gets id GAME_ZERO
+  internForm(games, NULL, 0, NULL, 0);
+}
+
+
+// Sorts ids and drops repeats, options are sets. Returns the new count.
+static U32 sortUnique(GameId *ids, U32 count) {
+  for (U32 i = 1; i < count; i++) {
+    GameId id = ids[i];
+    U32 j = i;
+    while (j > 0 && ids[j-1] > id) {
+      ids[j] = ids[j-1];
+      j--;
+    }
+    ids[j] = id;
+  }
+
+  U32 unique = 0;
+  for (U32 i = 0; i < count; i++) {
+    if (!unique || ids[unique-1] != ids[i]) ids[unique++] = ids[i];
+  }
+  return unique;
+}
+
+
+static U64 hashOptions(const GameId *left, U32 leftCount, const GameId *right, U32 rightCount) {
+  U64 hash = hashMix(leftCount * 0x10001ull + rightCount);
+  for (U32 i = 0; i < leftCount; i++) hash = hashMix(hash ^ left[i]);
+  hash = hashMix(hash ^ 0x9E3779B97F4A7C15ull);
+  for (U32 i = 0; i < rightCount; i++) hash = hashMix(hash ^ right[i]);
+  return hash;
+}
+
+
+/*
+ * Finds or adds the game with exactly these options, canonical or not.
+ * Both lists must already be sorted and free of repeats.
+ */
+static GameId internForm(GameStore *games, const GameId *left, U32 leftCount, const GameId *right, U32 rightCount) {
+  U32 slot = hashOptions(left, leftCount, right, rightCount) & games->internMask;
+
+  for (;; slot = (slot + 1) & games->internMask) {
+    GameId id = games->intern[slot];
+    if (id == GAME_NONE) break;
+
+    Game *game = &games->games[id];
+    if (game->leftCount != leftCount || game->rightCount != rightCount) continue;
+    GameId *options = &games->options[game->options];
+    if (!memcmp(options, left, leftCount * sizeof(GameId)) &&
+        !memcmp(options + leftCount, right, rightCount * sizeof(GameId))) return id;
+  }
+
+  // keep the table at most half full so probes stay short
+  if (games->gameCount >= games->gameCap || games->gameCount * 2 >= games->internMask ||
+      games->optionCount + leftCount + rightCount > games->optionCap) {
+    games->full = Bool_True;
+    return GAME_ZERO;
+  }
+
+  GameId id = games->gameCount++;
+  Game *game = &games->games[id];
+  game->options = games->optionCount;
+  game->leftCount = leftCount;
+  game->rightCount = rightCount;
+  memcpy(&games->options[games->optionCount], left, leftCount * sizeof(GameId));
+  memcpy(&games->options[games->optionCount + leftCount], right, rightCount * sizeof(GameId));
+  games->optionCount += leftCount + rightCount;
+  games->intern[slot] = id;
+
+  return id;
+}
+
+
+static inline GameId *leftOptions(GameStore *games, GameId id) {
+  return &games->options[games->games[id].options];
+}
+
+static inline GameId *rightOptions(GameStore *games, GameId id) {
+  return &games->options[games->games[id].options + games->games[id].leftCount];
+}
+
+
+/*
+ * g <= h unless Left can move from g to something at least h, or Right
+ * can move from h to something at most g. Works on any forms, not just
+ * canonical ones. The memo table just stops remembering once it fills up.
+ */
+Bool GameLeq(GameStore *games, GameId g, GameId h) {
+  if (g == h) return Bool_True;
+
+  U64 key = ((U64)g << 32) | h;
+  U32 slot = hashMix(key) & games->leqMask;
+  for (; games->leqKeys[slot] != ~0ull; slot = (slot + 1) & games->leqMask) {
+    if (games->leqKeys[slot] == key) return games->leqValues[slot];
+  }
+
+  Bool result = Bool_True;
+  GameId *gLeft = leftOptions(games, g);
+  for (U32 i = 0; i < games->games[g].leftCount && result; i++) {
+    if (GameLeq(games, h, gLeft[i])) result = Bool_False;
+  }
+  GameId *hRight = rightOptions(games, h);
+  for (U32 i = 0; i < games->games[h].rightCount && result; i++) {
+    if (GameLeq(games, hRight[i], g)) result = Bool_False;
+  }
+
+  // the recursion may have filled the slot we found, so look again
+  if (games->leqCount * 4 < games->leqMask * 3) {
+    slot = hashMix(key) & games->leqMask;
+    while (games->leqKeys[slot] != ~0ull) slot = (slot + 1) & games->leqMask;
+    games->leqKeys[slot] = key;
+    games->leqValues[slot] = result;
+    games->leqCount++;
+  }
+
+  return result;
+}
+
+
+// Drops options another option of the same side is at least as good as.
+// Options are canonical so different ids are never equal games.
+static U32 removeDominated(GameStore *games, GameId *ids, U32 count, Bool isLeft) {
+  U32 kept = 0;
+  for (U32 i = 0; i < count; i++) {
+    Bool dominated = Bool_False;
+    for (U32 j = 0; j < count && !dominated; j++) {
+      if (i == j) continue;
+      dominated = (isLeft) ? GameLeq(games, ids[i], ids[j]) : GameLeq(games, ids[j], ids[i]);
+    }
+    if (!dominated) ids[kept++] = ids[i];
+  }
+  return kept;
+}
+
+
+/*
+ * The canonical form of { left | right } when the options are canonical.
+ * A Left option A is reversible when Right has an answer A^R <= g, then
+ * Left moving to A is as good as Left getting to pick from A^R's Left
+ * options, so those replace A (and the same the other way for Right).
+ * Bypassing reversible options and dropping dominated ones until neither
+ * changes anything leaves the unique smallest form of the game.
+ */
+GameId GameFromOptions(GameStore *games, const GameId *left, U32 leftCount, const GameId *right, U32 rightCount) {
+  GameId l[GAME_MAX_OPTIONS], r[GAME_MAX_OPTIONS];
+  GameId next[GAME_MAX_OPTIONS];
+  if (leftCount > GAME_MAX_OPTIONS || rightCount > GAME_MAX_OPTIONS) {
+    games->full = Bool_True;
+    return GAME_ZERO;
+  }
+  memcpy(l, left, leftCount * sizeof(GameId));
+  memcpy(r, right, rightCount * sizeof(GameId));
+
+  for (;;) {
+    leftCount = sortUnique(l, leftCount);
+    rightCount = sortUnique(r, rightCount);
+    leftCount = removeDominated(games, l, leftCount, Bool_True);
+    rightCount = removeDominated(games, r, rightCount, Bool_False);
+    GameId g = internForm(games, l, leftCount, r, rightCount);
+    if (games->full) return GAME_ZERO;
+
+    // Bypassing keeps the value, so every option is checked against the same g
+    Bool changed = Bool_False;
+    U32 nextCount = 0;
+    for (U32 i = 0; i < leftCount; i++) {
+      GameId a = l[i];
+      GameId *aRight = rightOptions(games, a);
+      GameId reverse = GAME_NONE;
+      for (U32 j = 0; j < games->games[a].rightCount && reverse == GAME_NONE; j++) {
+        if (GameLeq(games, aRight[j], g)) reverse = aRight[j];
+      }
+
+      if (reverse == GAME_NONE) {
+        next[nextCount++] = a;
+        continue;
+      }
+      changed = Bool_True;
+      U32 count = games->games[reverse].leftCount;
+      if (nextCount + count > GAME_MAX_OPTIONS) {
+        games->full = Bool_True;
+        return GAME_ZERO;
+      }
+      memcpy(&next[nextCount], leftOptions(games, reverse), count * sizeof(GameId));
+      nextCount += count;
+    }
+    memcpy(l, next, nextCount * sizeof(GameId));
+    leftCount = nextCount;
+
+    nextCount = 0;
+    for (U32 i = 0; i < rightCount; i++) {
+      GameId b = r[i];
+      GameId *bLeft = leftOptions(games, b);
+      GameId reverse = GAME_NONE;
+      for (U32 j = 0; j < games->games[b].leftCount && reverse == GAME_NONE; j++) {
+        if (GameLeq(games, g, bLeft[j])) reverse = bLeft[j];
+      }
+
+      if (reverse == GAME_NONE) {
+        next[nextCount++] = b;
+        continue;
+      }
+      changed = Bool_True;
+      U32 count = games->games[reverse].rightCount;
+      if (nextCount + count > GAME_MAX_OPTIONS) {
+        games->full = Bool_True;
+        return GAME_ZERO;
+      }
+      memcpy(&next[nextCount], rightOptions(games, reverse), count * sizeof(GameId));
+      nextCount += count;
+    }
+    memcpy(r, next, nextCount * sizeof(GameId));
+    rightCount = nextCount;
+
+    if (!changed) return g;
+  }
+}
+
+
+// g + h = { g^L + h, g + h^L | g^R + h, g + h^R }
+GameId GameSum(GameStore *games, GameId g, GameId h) {
+  if (g == GAME_ZERO) return h;
+  if (h == GAME_ZERO) return g;
+  if (games->full) return GAME_ZERO;
+  if (g > h) {
+    GameId swap = g;
+    g = h;
+    h = swap;
+  }
+
+  U64 key = ((U64)g << 32) | h;
+  U32 slot = hashMix(key) & games->sumMask;
+  for (; games->sumKeys[slot] != ~0ull; slot = (slot + 1) & games->sumMask) {
+    if (games->sumKeys[slot] == key) return games->sumValues[slot];
+  }
+
+  Game gGame = games->games[g], hGame = games->games[h];
+  if (gGame.leftCount + hGame.leftCount > GAME_MAX_OPTIONS ||
+      gGame.rightCount + hGame.rightCount > GAME_MAX_OPTIONS) {
+    games->full = Bool_True;
+    return GAME_ZERO;
+  }
+
+  GameId left[GAME_MAX_OPTIONS], right[GAME_MAX_OPTIONS];
+  U32 leftCount = 0, rightCount = 0;
+  for (U32 i = 0; i < gGame.leftCount; i++) left[leftCount++] = GameSum(games, leftOptions(games, g)[i], h);
+  for (U32 i = 0; i < hGame.leftCount; i++) left[leftCount++] = GameSum(games, g, leftOptions(games, h)[i]);
+  for (U32 i = 0; i < gGame.rightCount; i++) right[rightCount++] = GameSum(games, rightOptions(games, g)[i], h);
+  for (U32 i = 0; i < hGame.rightCount; i++) right[rightCount++] = GameSum(games, g, rightOptions(games, h)[i]);
+
+  GameId sum = GameFromOptions(games, left, leftCount, right, rightCount);
+  if (games->full) return GAME_ZERO;
+
+  if (games->sumCount * 4 < games->sumMask * 3) {
+    slot = hashMix(key) & games->sumMask;
+    while (games->sumKeys[slot] != ~0ull) slot = (slot + 1) & games->sumMask;
+    games->sumKeys[slot] = key;
+    games->sumValues[slot] = sum;
+    games->sumCount++;
+  }
+
+  return sum;
+}
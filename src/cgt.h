@@ -0,0 +1,70 @@
+/*
+  USAGE:
+    The files cgt.h and cgt.c are for combinatorial game values of short
+    partizan games, the kind Konane endgames are made of. Left is white
+    and Right is black.
+
+    A game is { left options | right options }. Every game made here is
+    kept in canonical form (no dominated or reversible options) and
+    interned, so two games are equal exactly when their GameIds are. Only
+    the options are stored, a position is turned into a game by solving
+    its children first:
+
+    GameStore *games = GameStoreInit(arena, capacity);
+    GameId value = GameFromOptions(games, left, leftCount, right, rightCount);
+    GameId total = GameSum(games, value, other);
+    if (!GameLeq(games, total, GAME_ZERO)) // white wins moving first
+    if (games->full) // everything since the last GameStoreClear() is garbage
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef CGT_H
+#define CGT_H
+
+#include "types.h"
+#include "allocators.h"
+
+typedef U32 GameId;
+#define GAME_ZERO 0 // { | }, whoever moves first loses
+#define GAME_MAX_OPTIONS 256 // per side, more than that and the store reports full
+
+typedef struct Game Game;
+struct Game {
+  U32 options;    // index of the first option in GameStore.options, left ones first
+  U16 leftCount;
+  U16 rightCount;
+};
+
+typedef struct GameStore GameStore;
+struct GameStore {
+  Game *games;
+  U32 gameCount;
+  U32 gameCap;
+  GameId *options;
+  U32 optionCount;
+  U32 optionCap;
+
+  // Open addressing tables, the capacities are powers of two
+  GameId *intern; // game ids by the hash of their options, ~0 is empty
+  U32 internMask;
+  U64 *leqKeys;   // g << 32 | h, ~0 is empty
+  U8 *leqValues;
+  U32 leqMask;
+  U32 leqCount;
+  U64 *sumKeys;
+  GameId *sumValues;
+  U32 sumMask;
+  U32 sumCount;
+
+  Bool full; // ran out of room, results can not be trusted until cleared
+};
+
+GameStore *GameStoreInit(Arena *arena, U32 capacity); // capacity games, about 100 bytes each
+void GameStoreClear(GameStore *games);
+GameId GameFromOptions(GameStore *games, const GameId *left, U32 leftCount, const GameId *right, U32 rightCount);
+GameId GameSum(GameStore *games, GameId g, GameId h);
+Bool GameLeq(GameStore *games, GameId g, GameId h); // g <= h, Right does at least as well in g
+
+#endif
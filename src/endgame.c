@@ -0,0 +1,243 @@
+#include <string.h>
+#include "endgame.h"
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "cgt.h"
+#include "timer.h"
+
+#define CLOCK_CHECK_POSITIONS 1024 // power of two, positions solved between looks at the clock
+#define GAME_BYTES 256 // generous size of a game with its share of the tables
+
+// Masks of the squares a stone can shift one or two files towards A
+// (bit index +1) or H (bit index -1) without wrapping into the next row
+#define TOWARDS_A_1 (0x7F * FILE_H)
+#define TOWARDS_A_2 (0x3F * FILE_H)
+#define TOWARDS_H_1 (0xFE * FILE_H)
+#define TOWARDS_H_2 (0xFC * FILE_H)
+
+
+static inline U64 hashMix(U64 x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+
+Endgame *EndgameInit(Arena *arena, U64 megabytes) {
+  Endgame *endgame = ArenaPush(arena, sizeof(Endgame));
+
+  // a quarter for the position cache, the rest for the games
+  U32 positionCount = 1;
+  while (positionCount * 2 * (sizeof(U64) + sizeof(GameId)) <= Megabyte(megabytes) / 4) positionCount *= 2;
+  endgame->positionKeys = ArenaPush(arena, positionCount * sizeof(U64));
+  endgame->positionValues = ArenaPushNoZero(arena, positionCount * sizeof(GameId));
+  endgame->positionMask = positionCount - 1;
+  endgame->positionCount = 0;
+
+  endgame->games = GameStoreInit(arena, Megabyte(megabytes) * 3 / 4 / GAME_BYTES);
+  return endgame;
+}
+
+
+// Every square within two squares in a line of a stone in bits
+static U64 dilate(U64 bits) {
+  return bits | (bits << 8) | (bits << 16) | (bits >> 8) | (bits >> 16) |
+         ((bits & TOWARDS_A_1) << 1) | ((bits & TOWARDS_A_2) << 2) |
+         ((bits & TOWARDS_H_1) >> 1) | ((bits & TOWARDS_H_2) >> 2);
+}
+
+
+// The pieces in occupied that could jump a piece in occupied onto a square
+// in empty, by direction. Bits are on the square the jump starts from.
+#define JUMP_UP(occupied, empty)    ((occupied) & ((occupied) >> 8) & ((empty) >> 16))
+#define JUMP_DOWN(occupied, empty)  ((occupied) & ((occupied) << 8) & ((empty) << 16))
+#define JUMP_LEFT(occupied, empty)  ((occupied) & ((occupied) >> 1) & ((empty) >> 2) & TOWARDS_A_2)
+#define JUMP_RIGHT(occupied, empty) ((occupied) & ((occupied) << 1) & ((empty) << 2) & TOWARDS_H_2)
+
+
+/*
+ * Every square that could ever be empty, if any stone could jump any other
+ * next to it. A jump empties the square it starts from and the one it
+ * passes over and fills the one it lands on. Squares are colored so only
+ * a stone of the right color can ever stand on each, which keeps this from
+ * being much too big. A stone whose square can never be empty never moves
+ * and is never taken, it is just a wall.
+ */
+static U64 everEmpty(U64 stones) {
+  U64 occupied = stones, empty = ~stones;
+  U64 prevOccupied, prevEmpty;
+  do {
+    prevOccupied = occupied;
+    prevEmpty = empty;
+    U64 up = JUMP_UP(occupied, empty), down = JUMP_DOWN(occupied, empty);
+    U64 left = JUMP_LEFT(occupied, empty), right = JUMP_RIGHT(occupied, empty);
+    empty |= up | (up << 8) | down | (down >> 8) | left | (left << 1) | right | (right >> 1);
+    occupied |= (up << 16) | (down >> 16) | (left << 2) | (right >> 2);
+  } while (occupied != prevOccupied || empty != prevEmpty);
+  return empty;
+}
+
+
+// Every square the stones in bits could ever stand on if they only jump
+// each other, landing on squares in empty
+static U64 reach(U64 bits, U64 empty) {
+  U64 prev;
+  do {
+    prev = bits;
+    bits |= (JUMP_UP(bits, empty) << 16) | (JUMP_DOWN(bits, empty) >> 16) |
+            (JUMP_LEFT(bits, empty) << 2) | (JUMP_RIGHT(bits, empty) >> 2);
+  } while (bits != prev);
+  return bits;
+}
+
+
+/*
+ * Walls are left out. The stones that can still move or be taken are first
+ * grouped when they are within two squares in a line of each other, then
+ * groups keep merging while one's reach comes within two squares of
+ * another's. Groups of only one color can never move and are left out too.
+ */
+U32 EndgameRegions(BitBoard board, U64 *regions, U64 *walls) {
+  U64 empty = everEmpty(board.whole);
+  U64 live = board.whole & empty;
+  *walls = board.whole & ~empty;
+
+  U64 regionsAll[64];
+  U32 count = 0;
+  U64 left = live;
+  while (left) {
+    U64 region = left & -left;
+    U64 prev;
+    do {
+      prev = region;
+      region |= dilate(region) & live;
+    } while (region != prev);
+    regionsAll[count++] = region;
+    left &= ~region;
+  }
+
+  U64 reaches[64];
+  for (U32 i = 0; i < count; i++) reaches[i] = reach(regionsAll[i], empty);
+
+  for (U32 i = 0; i < count; i++) {
+    for (U32 j = i + 1; j < count; j++) {
+      if (!(dilate(reaches[i]) & reaches[j])) continue;
+      regionsAll[i] |= regionsAll[j];
+      reaches[i] = reach(regionsAll[i], empty);
+      regionsAll[j] = regionsAll[--count];
+      reaches[j] = reaches[count];
+      j = i; // region i grew, check everything after it again
+    }
+  }
+
+  U32 kept = 0;
+  for (U32 i = 0; i < count; i++) {
+    if ((regionsAll[i] & ALL_WHITE) && (regionsAll[i] & ALL_BLACK)) regions[kept++] = regionsAll[i];
+  }
+  return kept;
+}
+
+
+// The game value of a board that only holds one region's stones and the
+// walls. Walls never change, so the same keys come back move after move.
+static GameId regionValue(Endgame *endgame, U64 local) {
+  U32 slot = hashMix(local) & endgame->positionMask;
+  for (; endgame->positionKeys[slot]; slot = (slot + 1) & endgame->positionMask) {
+    if (endgame->positionKeys[slot] == local) return endgame->positionValues[slot];
+  }
+
+  if (!(++endgame->positionsSolved & (CLOCK_CHECK_POSITIONS - 1)) && TimerNow() >= endgame->deadline) {
+    endgame->failed = Bool_True;
+  }
+  if (endgame->failed || endgame->games->full) return GAME_ZERO;
+
+  BitBoard board = { .whole = local };
+  MoveList moves;
+  GameId left[MAX_MOVES], right[MAX_MOVES];
+
+  U32 leftCount = GenerateMoves(board, PlayerKind_White, &moves);
+  for (U32 i = 0; i < leftCount; i++) left[i] = regionValue(endgame, local ^ MoveMask(moves.moves[i]));
+  U32 rightCount = GenerateMoves(board, PlayerKind_Black, &moves);
+  for (U32 i = 0; i < rightCount; i++) right[i] = regionValue(endgame, local ^ MoveMask(moves.moves[i]));
+
+  GameId value = GameFromOptions(endgame->games, left, leftCount, right, rightCount);
+  if (endgame->failed || endgame->games->full) return GAME_ZERO;
+
+  // a full cache just stops remembering
+  if (endgame->positionCount * 4 < endgame->positionMask * 3) {
+    slot = hashMix(local) & endgame->positionMask;
+    while (endgame->positionKeys[slot]) slot = (slot + 1) & endgame->positionMask;
+    endgame->positionKeys[slot] = local;
+    endgame->positionValues[slot] = value;
+    endgame->positionCount++;
+  }
+
+  return value;
+}
+
+
+static void endgameClear(Endgame *endgame) {
+  GameStoreClear(endgame->games);
+  memset(endgame->positionKeys, 0, (endgame->positionMask + 1) * sizeof(U64));
+  endgame->positionCount = 0;
+}
+
+
+/*
+ * A move wins if the opponent, moving first in the sum that is left, loses.
+ * White is Left, so white wins with black to move when the sum is >= 0,
+ * and black wins with white to move when it is <= 0.
+ */
+EndgameOutcome EndgameSolve(Endgame *endgame, BitBoard board, PlayerKind player, U64 deadline, Move *move) {
+  *move = MOVE_NONE;
+  MoveList list;
+  if (!GenerateMoves(board, player, &list)) return EndgameOutcome_Loss;
+
+  U64 regions[ENDGAME_MAX_REGIONS], walls;
+  U32 count = EndgameRegions(board, regions, &walls);
+  for (U32 i = 0; i < count; i++) {
+    if (PopCount(regions[i]) > ENDGAME_MAX_REGION_STONES) return EndgameOutcome_Unknown;
+  }
+
+  // Values from earlier moves are kept, unless they left too little room
+  GameStore *games = endgame->games;
+  if (games->full || games->gameCount * 2 > games->gameCap) endgameClear(endgame);
+  endgame->deadline = deadline;
+  endgame->failed = Bool_False;
+
+  // others[i] is the sum of every region but i
+  GameId values[ENDGAME_MAX_REGIONS], others[ENDGAME_MAX_REGIONS];
+  for (U32 i = 0; i < count; i++) values[i] = regionValue(endgame, (board.whole & regions[i]) | walls);
+  GameId prefix = GAME_ZERO;
+  for (U32 i = 0; i < count; i++) {
+    others[i] = prefix;
+    prefix = GameSum(games, prefix, values[i]);
+  }
+  GameId suffix = GAME_ZERO;
+  for (U32 i = count; i-- > 0;) {
+    others[i] = GameSum(games, others[i], suffix);
+    suffix = GameSum(games, values[i], suffix);
+  }
+
+  for (U32 m = 0; m < list.count && !endgame->failed && !games->full; m++) {
+    U64 from = 1llu << MoveFrom(list.moves[m]);
+    U32 i = 0;
+    while (!(regions[i] & from)) i++;
+
+    GameId child = regionValue(endgame, ((board.whole & regions[i]) | walls) ^ MoveMask(list.moves[m]));
+    GameId total = GameSum(games, others[i], child);
+    if (endgame->failed || games->full) break;
+
+    Bool win = (player == PlayerKind_White) ? GameLeq(games, GAME_ZERO, total) : GameLeq(games, total, GAME_ZERO);
+    if (win) {
+      *move = list.moves[m];
+      return EndgameOutcome_Win;
+    }
+  }
+
+  // Nothing half made is ever cached, so values found before the clock ran
+  // out are kept for the next move. A full store is cleared next time.
+  if (endgame->failed || games->full) return EndgameOutcome_Unknown;
+  return EndgameOutcome_Loss;
+}
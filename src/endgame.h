@@ -0,0 +1,66 @@
+/*
+  USAGE:
+    The files endgame.h and endgame.c are for solving late game positions
+    exactly. Near the end the stones break up into groups that can never
+    reach each other, so the position is a sum of independent games. Each
+    group is solved on its own into a combinatorial game value (see cgt.h),
+    cached by the group's stones, and the values are added up to tell who
+    wins and which move keeps the win.
+
+    First every stone that can never move or be taken is found, those are
+    just walls that stay where they are. Two groups of the other stones
+    are independent when no square either could ever put a stone on is
+    within two squares in a line of one the other could. Both are worked
+    out as if every stone could jump any stone next to it, which is more
+    than they really can, so groups are sometimes kept together when they
+    did not need to be but never split when they interact. A group is
+    solved on a board with only its own stones and the walls.
+
+    Endgame *endgame = EndgameInit(arena, ENDGAME_DEFAULT_MEGABYTES);
+    Move move;
+    if (EndgameSolve(endgame, board, player, deadline, &move) == EndgameOutcome_Win) ...
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "cgt.h"
+
+#define ENDGAME_DEFAULT_MEGABYTES 64
+#define ENDGAME_MOVABLE_PIECES 12 // agentMove() tries the solver when fewer pieces than this can move
+#define ENDGAME_MAX_REGION_STONES 20 // bigger regions can take seconds to solve, walls are not counted
+#define ENDGAME_MAX_REGIONS 32 // every region has at least one stone of each color
+
+typedef U8 EndgameOutcome;
+enum {
+  EndgameOutcome_Unknown, // too big or out of time
+  EndgameOutcome_Win,     // the player to move wins with the move returned
+  EndgameOutcome_Loss,    // every move loses against perfect play
+};
+
+typedef struct Endgame Endgame;
+struct Endgame {
+  GameStore *games;
+
+  // Game values of single regions, keyed by the region's stones alone
+  U64 *positionKeys; // 0 is empty, an empty board is GAME_ZERO anyway
+  GameId *positionValues;
+  U32 positionMask;
+  U32 positionCount;
+
+  U64 deadline;
+  U64 positionsSolved;
+  Bool failed;
+};
+
+Endgame *EndgameInit(Arena *arena, U64 megabytes); // the arena needs megabytes plus a little room
+U32 EndgameRegions(BitBoard board, U64 *regions, U64 *walls); // splits the stones into independent regions, returns the count
+EndgameOutcome EndgameSolve(Endgame *endgame, BitBoard board, PlayerKind player, U64 deadline, Move *move);
+
+#endif
@@ -0,0 +1,33 @@
+#include <string.h>
+#include "eval.h"
+#include "types.h"
+#include "movegen.h"
+#include "endgame.h"
+
+
+// Regions white can still move in less the ones black can, a region is
+// worth something to whoever can move there, however many pieces it is
+I32 EvalRegions(const Mobility *mobility) {
+  U64 regions[ENDGAME_MAX_REGIONS], walls;
+  U32 count = EndgameRegions((BitBoard){ .whole = mobility->board }, regions, &walls);
+
+  I32 balance = 0;
+  for (U32 i = 0; i < count; i++) {
+    balance += (regions[i] & mobility->movable[PlayerKind_White]) != 0;
+    balance -= (regions[i] & mobility->movable[PlayerKind_Black]) != 0;
+  }
+  return balance;
+}
+
+
+void EvalFeatures(const Mobility *mobility, I8 *features) {
+  U64 white = mobility->movable[PlayerKind_White];
+  U64 black = mobility->movable[PlayerKind_Black];
+
+  memset(features, 0, EVAL_FEATURE_STRIDE);
+  features[EvalFeature_Mobility] = PopCount(white) - PopCount(black);
+  features[EvalFeature_Corners] = PopCount(white & CORNER_PIECES) - PopCount(black & CORNER_PIECES);
+  features[EvalFeature_Edges] = PopCount(white & EDGE_PIECES) - PopCount(black & EDGE_PIECES);
+  features[EvalFeature_Parity] = (mobility->toMove == PlayerKind_White) ? 1 : -1;
+  features[EvalFeature_Regions] = EvalRegions(mobility);
+}
@@ -0,0 +1,68 @@
+/*
+  USAGE:
+    The files eval.h and eval.c are for the features the evaluation adds
+    up. Every feature is white's count less black's, the weights they are
+    multiplied by are in weights.h, which tune.c writes:
+
+    Mobility mobility;
+    MobilityFromBoard(board, player, Bool_False, &mobility);
+    I8 features[EVAL_FEATURE_STRIDE];
+    EvalFeatures(&mobility, features);
+
+    MobilityEvaluate() in agent.c computes the same sum straight from the
+    mobility and leaves out every feature whose weight is 0, so a feature
+    nobody uses costs the search nothing.
+
+    The labelled positions tune.c learns from are in a PositionsHeader
+    followed by PositionEntries, match.exe --record writes them.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "types.h"
+#include "movegen.h"
+#include "weights.h"
+
+#define EDGE_PIECES   0x1800008181000018
+#define CORNER_PIECES 0x8100000000000081
+#define EVAL_SCALE 4 // the weights are in quarters of a movable piece, score margins are multiples of this
+#define EVAL_FEATURE_STRIDE 8 // bytes per position in EvalFeatures(), the count rounded up
+
+#define POSITIONS_MAGIC "KONANEPS"
+#define POSITIONS_VERSION 1 // bump whenever the layout changes
+
+typedef U8 EvalFeature;
+enum {
+  EvalFeature_Mobility, // pieces with a jump
+  EvalFeature_Corners,  // of those, the ones in a corner
+  EvalFeature_Edges,    // of those, the ones in EDGE_PIECES
+  EvalFeature_Parity,   // 1 when white is to move, -1 when black is
+  EvalFeature_Regions,  // regions (see EndgameRegions()) with a piece that can move
+  EvalFeature_Count,
+};
+
+typedef struct PositionsHeader PositionsHeader;
+struct PositionsHeader {
+  char magic[8];
+  U32 version;
+  U32 unused;
+  U64 count; // entries after the header
+};
+
+typedef struct PositionEntry PositionEntry;
+struct PositionEntry {
+  U64 board;
+  PlayerKind player; // to move
+  PlayerKind winner; // of the game the position was played in
+  U16 unused;
+  U32 unused2;
+};
+
+I32 EvalRegions(const Mobility *mobility);
+void EvalFeatures(const Mobility *mobility, I8 *features); // fills EVAL_FEATURE_STRIDE bytes, the unused ones with 0
+
+#endif
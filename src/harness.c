@@ -0,0 +1,352 @@
+/*
+  USAGE:
+    harness.c plays konane.exe against opponent.exe through pipes, the way
+    the course's drivercheck.pl plays it against konanerandomplayer, so
+    whole games can be run and timed offline:
+
+    make harness
+    ./harness.exe <random|greedy|minimax> [--games N] [--depth D] [--timeout MS] [--konane PATH] [-- konane options]
+
+    Both programs move first from the board file they are started with,
+    so each side is started on its first turn from the board as it is
+    then. After that the harness passes every move on to the other side.
+    Every move is checked against the move generator, an illegal move,
+    giving up early, dying or taking longer than the timeout loses the
+    game. konane.exe takes both colours, black in the even games.
+
+    At the end it prints the score and each side's time to move
+    percentiles. A side's first move includes starting the program.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "boardio.h"
+#include "book.h"
+#include "timer.h"
+
+#define HARNESS_DEFAULT_GAMES 10
+#define HARNESS_DEFAULT_TIMEOUT 60000 // milliseconds
+#define HARNESS_MAX_ARGS 64
+
+// A program we play against through its stdin and stdout
+typedef struct Child Child;
+struct Child {
+  pid_t pid; // 0 when not running
+  int in;
+  int out;
+  U32 length;
+  char buffer[1 << 16]; // read but not yet split into lines
+};
+
+typedef struct Harness Harness;
+struct Harness {
+  const char *opponent;
+  const char *konanePath;
+  char *boardPath;
+  char depth[16];
+  char **konaneArgs; // passed on after the board file and the colour
+  int konaneArgCount;
+  U64 timeout;
+
+  // nanoseconds per move, by side: 0 is konane.exe, 1 the opponent
+  U64 *times[2];
+  U32 timeCount[2];
+};
+
+
+static Bool childStart(Child *child, char **argv) {
+  int toChild[2], fromChild[2];
+  if (pipe(toChild)) return Bool_False;
+  if (pipe(fromChild)) {
+    close(toChild[0]);
+    close(toChild[1]);
+    return Bool_False;
+  }
+
+  pid_t pid = fork();
+  if (!pid) {
+    dup2(toChild[0], STDIN_FILENO);
+    dup2(fromChild[1], STDOUT_FILENO);
+    close(toChild[0]);
+    close(toChild[1]);
+    close(fromChild[0]);
+    close(fromChild[1]);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+
+  close(toChild[0]);
+  close(fromChild[1]);
+  if (pid < 0) {
+    close(toChild[1]);
+    close(fromChild[0]);
+    return Bool_False;
+  }
+  child->pid = pid;
+  child->in = toChild[1];
+  child->out = fromChild[0];
+  child->length = 0;
+  return Bool_True;
+}
+
+
+static void childStop(Child *child) {
+  if (!child->pid) return;
+  kill(child->pid, SIGKILL);
+  waitpid(child->pid, NULL, 0);
+  close(child->in);
+  close(child->out);
+  child->pid = 0;
+}
+
+
+// The next line of output without the colour codes, false if the child
+// died or deadline passed first
+static Bool childReadLine(Child *child, char *line, U32 size, U64 deadline) {
+  for (;;) {
+    char *newline = memchr(child->buffer, '\n', child->length);
+    if (newline) {
+      U32 length = newline - child->buffer;
+      U32 j = 0;
+      for (U32 i = 0; i < length; i++) {
+        char c = child->buffer[i];
+        if (c == '\x1b') {
+          while (i < length && !isalpha((unsigned char)child->buffer[i])) i++; // up to the 'm'
+        } else if (c != '\r' && j + 1 < size) {
+          line[j++] = c;
+        }
+      }
+      line[j] = '\0';
+      child->length -= length + 1;
+      memmove(child->buffer, newline + 1, child->length);
+      return Bool_True;
+    }
+    if (child->length == sizeof(child->buffer)) child->length = 0; // no move is this long
+
+    U64 now = TimerNow();
+    if (now >= deadline) return Bool_False;
+    struct pollfd poller = { .fd = child->out, .events = POLLIN };
+    if (poll(&poller, 1, (int)((deadline - now) / NANOSECONDS_PER_MILLISECOND) + 1) <= 0) continue;
+
+    ssize_t got = read(child->out, child->buffer + child->length, sizeof(child->buffer) - child->length);
+    if (got <= 0) return Bool_False;
+    child->length += got;
+  }
+}
+
+
+static Bool isSquare(const char *text) {
+  return text[0] >= 'A' && text[0] <= 'H' && text[1] >= '1' && text[1] <= '8';
+}
+
+static U8 squareFromText(const char *text) {
+  char square[3] = { text[0], text[1], '\0' };
+  return IndexFromCoord(CoordFromInput(square));
+}
+
+
+/*
+ * Waits for the child's move: a removal is a square on a line of its own,
+ * a jump comes after "Agent move: ". *text gets it as the other side has
+ * to be sent it. False if the child gave up, died or ran out of time.
+ */
+static Bool childReadMove(Child *child, U64 deadline, Move *move, char *text) {
+  char line[256];
+  while (childReadLine(child, line, sizeof(line), deadline)) {
+    char *start = line;
+    while (!strncmp(start, "Your move: ", 11)) start += 11;
+
+    if (!strncmp(start, "Lost", 4)) return Bool_False;
+    if (isSquare(start) && start[2] == '\0') {
+      *move = MoveRemoval(squareFromText(start));
+      strcpy(text, start);
+      return Bool_True;
+    }
+    if (!strncmp(start, "Agent move: ", 12)) {
+      char *jump = start + 12;
+      if (strlen(jump) != MOVE_LENGTH - 1 || !isSquare(jump) || jump[2] != '-' || !isSquare(jump + 3)) return Bool_False;
+      *move = MoveMake(squareFromText(jump), squareFromText(jump + 3));
+      strcpy(text, jump);
+      return Bool_True;
+    }
+  }
+  return Bool_False;
+}
+
+
+static Bool harnessMoves(BitBoard board, PlayerKind player, MoveList *list) {
+  return OpeningRemovals(board, player, list) || GenerateMoves(board, player, list);
+}
+
+
+// Starts side's program with the board as it is now
+static Bool harnessStart(Harness *harness, Child *child, U32 side, PlayerKind player, BitBoard board, U32 game) {
+  FILE *fp = fopen(harness->boardPath, "w");
+  if (!fp) return Bool_False;
+  BitBoardFilePrint(fp, board);
+  fclose(fp);
+
+  char colour[2] = { (player == PlayerKind_White) ? 'W' : 'B', '\0' };
+  char seed[16];
+  snprintf(seed, sizeof(seed), "%u", game + 1);
+  char *argv[HARNESS_MAX_ARGS];
+  int argc = 0;
+  if (side == 0) {
+    argv[argc++] = (char*)harness->konanePath;
+    argv[argc++] = harness->boardPath;
+    argv[argc++] = colour;
+    for (int i = 0; i < harness->konaneArgCount; i++) argv[argc++] = harness->konaneArgs[i];
+  } else {
+    char *rest[] = { "./opponent.exe", harness->boardPath, colour, "--player", (char*)harness->opponent,
+                     "--depth", harness->depth, "--seed", seed };
+    for (U32 i = 0; i < sizeof(rest) / sizeof(rest[0]); i++) argv[argc++] = rest[i];
+  }
+  argv[argc] = NULL;
+  return childStart(child, argv);
+}
+
+
+// One game, returns the side that won: 0 for konane.exe, 1 for the opponent
+static U32 harnessPlayGame(Harness *harness, U32 game) {
+  PlayerKind konanePlayer = (game & 1) ? PlayerKind_White : PlayerKind_Black;
+  Child *children[2] = { calloc(1, sizeof(Child)), calloc(1, sizeof(Child)) }; // by side
+  BitBoard board = { .whole = ~0llu };
+  PlayerKind player = PlayerKind_Black;
+  char last[MOVE_LENGTH] = "";
+  const char *reason = "has no move";
+  U32 plies = 0;
+
+  MoveList list;
+  while (harnessMoves(board, player, &list)) {
+    U32 side = (player == konanePlayer) ? 0 : 1;
+    Child *mover = children[side];
+    U64 start = TimerNow();
+
+    if (!mover->pid) {
+      if (!harnessStart(harness, mover, side, player, board, game)) {
+        reason = "could not be started";
+        break;
+      }
+    } else {
+      char line[MOVE_LENGTH + 1];
+      snprintf(line, sizeof(line), "%s\n", last);
+      if (write(mover->in, line, strlen(line)) != (ssize_t)strlen(line)) {
+        reason = "stopped reading";
+        break;
+      }
+    }
+
+    Move move;
+    if (!childReadMove(mover, start + harness->timeout * NANOSECONDS_PER_MILLISECOND, &move, last)) {
+      reason = (TimerNow() - start >= harness->timeout * NANOSECONDS_PER_MILLISECOND) ? "ran out of time" : "gave up or died";
+      break;
+    }
+    harness->times[side][harness->timeCount[side]++] = TimerNow() - start;
+
+    U32 i = 0;
+    while (i < list.count && list.moves[i] != move) i++;
+    if (i == list.count) {
+      reason = "played an illegal move";
+      break;
+    }
+    board.whole ^= (MoveIsRemoval(move)) ? 1llu << MoveFrom(move) : MoveMask(move);
+    player = PlayerOpponent(player);
+    plies++;
+  }
+
+  U32 loser = (player == konanePlayer) ? 0 : 1;
+  printf("Game %u: konane.exe as %s %s after %u plies, %s %s\n", game + 1,
+         (konanePlayer == PlayerKind_White) ? "white" : "black", (loser) ? "won" : "lost", plies,
+         (loser) ? harness->opponent : "konane.exe", reason);
+
+  childStop(children[0]);
+  childStop(children[1]);
+  free(children[0]);
+  free(children[1]);
+  return loser;
+}
+
+
+static int compareTimes(const void *a, const void *b) {
+  U64 x = *(const U64*)a, y = *(const U64*)b;
+  return (x > y) - (x < y);
+}
+
+static void harnessPrintTimes(const char *name, U64 *times, U32 count) {
+  if (!count) return;
+  qsort(times, count, sizeof(U64), compareTimes);
+  double ms = NANOSECONDS_PER_MILLISECOND;
+  printf("%-12s %5u moves  time to move p50 %.1f ms  p90 %.1f ms  p99 %.1f ms  max %.1f ms\n", name, count,
+         times[count / 2] / ms, times[count * 9 / 10] / ms, times[count * 99 / 100] / ms, times[count - 1] / ms);
+}
+
+
+int main(int argc, char **argv) {
+  Harness harness = {
+    .konanePath = "./konane.exe",
+    .timeout = HARNESS_DEFAULT_TIMEOUT,
+  };
+  U32 games = HARNESS_DEFAULT_GAMES;
+  int depth = 3;
+
+  Bool ok = argc >= 2 && (!strcmp(argv[1], "random") || !strcmp(argv[1], "greedy") || !strcmp(argv[1], "minimax"));
+  if (ok) harness.opponent = argv[1];
+  for (int i = 2; ok && i < argc; i++) {
+    if (!strcmp(argv[i], "--games") && i + 1 < argc) games = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--depth") && i + 1 < argc) depth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--timeout") && i + 1 < argc) harness.timeout = strtoull(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--konane") && i + 1 < argc) harness.konanePath = argv[++i];
+    else if (!strcmp(argv[i], "--")) {
+      harness.konaneArgs = &argv[i + 1];
+      harness.konaneArgCount = argc - i - 1;
+      ok = harness.konaneArgCount < HARNESS_MAX_ARGS - 4;
+      break;
+    }
+    else ok = Bool_False;
+  }
+  if (!ok) {
+    printf("usage: harness.exe <random|greedy|minimax> [--games N] [--depth D] [--timeout MS] [--konane PATH] [-- konane options]\n");
+    return -1;
+  }
+  snprintf(harness.depth, sizeof(harness.depth), "%d", depth);
+
+  char boardPath[] = "/tmp/konane-harness-XXXXXX";
+  int fd = mkstemp(boardPath);
+  if (fd < 0) {
+    printf("Could not make a board file in /tmp\n");
+    return -1;
+  }
+  close(fd);
+  harness.boardPath = boardPath;
+  signal(SIGPIPE, SIG_IGN); // a side that died is noticed when its move does not come
+
+  // A game is at most MAX_PLY moves, every jump takes a stone
+  Arena *arena = ArenaInit(2 * (U64)games * MAX_PLY * sizeof(U64) + Megabyte(1));
+  for (U32 side = 0; side < 2; side++) harness.times[side] = ArenaPush(arena, (U64)games * MAX_PLY * sizeof(U64));
+
+  U32 wins = 0;
+  for (U32 game = 0; game < games; game++) {
+    wins += harnessPlayGame(&harness, game);
+    fflush(stdout);
+  }
+
+  printf("\nkonane.exe %u - %u %s\n", wins, games - wins, harness.opponent);
+  harnessPrintTimes("konane.exe", harness.times[0], harness.timeCount[0]);
+  harnessPrintTimes(harness.opponent, harness.times[1], harness.timeCount[1]);
+
+  unlink(boardPath);
+  ArenaDeinit(arena);
+  return 0;
+}
@@ -25,6 +25,8 @@
 #include "boardio.h"
 #include "allocators.h"
 #include "agent.h"
+#include "movegen.h"
+#include "timer.h"
 
 #include <string.h>
 
@@ -108,44 +110,548 @@ void GenerateAllMoves(Arena *arena, StateNode *parent, U64 turn) {
   
 }
 
+void PrintUsage(void) {
+  printf("usage: konane.exe <boardfile> <B|W> [options]\n");
+  printf("       konane.exe perft <boardfile> <B|W> <depth> [--no-check]\n");
+  printf("       konane.exe bench <boardfile> <B|W> [options]\n");
+  printf("       konane.exe endgame <boardfile> <B|W> [--no-check]\n");
+  printf("       konane.exe treebench <boardfile> <B|W> <depth>\n");
+  printf("  --engine <ab|ybwc|tree|mcts> search engine to use (default ab)\n");
+  printf("  --time <ms>          thinking time per move (default %d)\n", DEFAULT_MOVE_TIME);
+  printf("  --hash <megabytes>   transposition table size (default %d)\n", TT_DEFAULT_MEGABYTES);
+  printf("  --threads <count>    search threads (default 1, bench defaults to every core)\n");
+  printf("  --depth <plies>      bench only: search to a fixed depth instead of for the move time\n");
+  printf("  --endgame <pieces>   solve exactly when fewer pieces can move (default %d, 0 never)\n", ENDGAME_MOVABLE_PIECES);
+  printf("  --tablebase <file>   tablebase made by tablegen.exe (default %s if it is there)\n", TABLEBASE_DEFAULT_PATH);
+  printf("  --book <file>        opening book made by bookgen.exe (default %s if it is there)\n", BOOK_DEFAULT_PATH);
+  printf("  --ponder             keep searching while the opponent thinks\n");
+  printf("  --telemetry <file>   add a JSON line per move to file, - for stderr\n");
+  printf("  --memory             print every arena's and pool's allocations to stderr after each move\n");
+}
+
+
+typedef struct Options Options;
+struct Options {
+  EngineKind engine;
+  U64 hashMegabytes;
+  U64 moveTime;
+  U32 threads;
+  int depth; // 0 searches for moveTime
+  U32 endgamePieces;
+  const char *tablebasePath; // NULL tries TABLEBASE_DEFAULT_PATH
+  const char *bookPath; // NULL tries BOOK_DEFAULT_PATH
+  const char *telemetryPath; // NULL for none, "-" for stderr
+  Bool ponder;
+  Bool memory;
+};
+
+
+// parses the --flags starting at argv[first], false if any are bad
+Bool ParseOptions(int argc, char **argv, int first, Options *options) {
+  for (int i = first; i < argc; i++) {
+    if (!strcmp(argv[i], "--engine") && i + 1 < argc) {
+      i++;
+      if (!strcmp(argv[i], "ab")) options->engine = EngineKind_AlphaBeta;
+      else if (!strcmp(argv[i], "ybwc")) options->engine = EngineKind_Ybwc;
+      else if (!strcmp(argv[i], "tree")) options->engine = EngineKind_Tree;
+      else if (!strcmp(argv[i], "mcts")) options->engine = EngineKind_Mcts;
+      else {
+        printf("Unknown engine \"%s\"\n", argv[i]);
+        return Bool_False;
+      }
+    } else if (!strcmp(argv[i], "--time") && i + 1 < argc) {
+      options->moveTime = strtoull(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--hash") && i + 1 < argc) {
+      options->hashMegabytes = strtoull(argv[++i], NULL, 10);
+      if (!options->hashMegabytes) options->hashMegabytes = 1;
+    } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      options->threads = strtoul(argv[++i], NULL, 10);
+      if (!options->threads) options->threads = 1;
+    } else if (!strcmp(argv[i], "--depth") && i + 1 < argc) {
+      options->depth = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--endgame") && i + 1 < argc) {
+      options->endgamePieces = max(atoi(argv[++i]), 0);
+    } else if (!strcmp(argv[i], "--tablebase") && i + 1 < argc) {
+      options->tablebasePath = argv[++i];
+    } else if (!strcmp(argv[i], "--book") && i + 1 < argc) {
+      options->bookPath = argv[++i];
+    } else if (!strcmp(argv[i], "--ponder")) {
+      options->ponder = Bool_True;
+    } else if (!strcmp(argv[i], "--telemetry") && i + 1 < argc) {
+      options->telemetryPath = argv[++i];
+    } else if (!strcmp(argv[i], "--memory")) {
+      options->memory = Bool_True;
+    } else {
+      printf("Dude, you got to use this thing properly\n");
+      PrintUsage();
+      return Bool_False;
+    }
+  }
+
+  return Bool_True;
+}
+
+
+// Maps in the tablebase, it is fine for the default one to be missing
+Bool LoadTablebase(Options *options) {
+  const char *path = (options->tablebasePath) ? options->tablebasePath : TABLEBASE_DEFAULT_PATH;
+  if (TablebaseLoad(path)) {
+    printf("Tablebase %s: every position with at most %u stones\n", path, tablebase.maxStones);
+    return Bool_True;
+  }
+  if (!options->tablebasePath) return Bool_True;
+
+  printf("Could not load the tablebase %s, it is missing or from another version\n", path);
+  return Bool_False;
+}
+
+
+// Maps in the opening book, it is fine for the default one to be missing
+Bool LoadBook(Options *options) {
+  const char *path = (options->bookPath) ? options->bookPath : BOOK_DEFAULT_PATH;
+  if (BookLoad(path)) {
+    printf("Opening book %s: %llu moves\n", path, book.count);
+    return Bool_True;
+  }
+  if (!options->bookPath) return Bool_True;
+
+  printf("Could not load the opening book %s, it is missing or from another version\n", path);
+  return Bool_False;
+}
+
+
+/**
+ * @brief Searches the same board with 1, 2, ... up to options->threads
+ * threads, starting from an empty table each time. For the move time it
+ * prints how nodes/second and depth scale. With --depth every run searches
+ * the same tree, so it prints the time to depth speedup over one thread
+ * and the search overhead, the extra nodes the threads searched.
+ */
+int BenchMain(Arena *arena, const char *boardFilePath, PlayerKind player, Options *options) {
+  BitBoard board = BitBoardFromFile(arena, boardFilePath);
+  TranspositionTable *tt = TTInit(arena, options->hashMegabytes);
+  EngineKind engine = (options->engine == EngineKind_Ybwc) ? EngineKind_Ybwc : EngineKind_AlphaBeta;
+  double baseRate = 0, baseSeconds = 0;
+  U64 baseNodes = 0;
+
+  if (options->depth) printf("threads  depth        nodes    seconds   nodes/second  speedup  overhead\n");
+  else printf("threads  depth        nodes   nodes/second  speedup\n");
+  for (U32 threads = 1; threads <= options->threads; threads++) {
+    TTClear(tt);
+    Agent agent = {
+      .player = player,
+      .engine = engine,
+      .tt = tt,
+      .depth = 1,
+      .maxDepth = options->depth,
+      .moveTime = (options->depth) ? 1000llu * 60 * 60 : options->moveTime,
+    };
+    AgentThreadsInit(&agent, arena, threads);
+
+    SearchResult result;
+    AgentSearch(&agent, board, &result);
+    AgentThreadsDeinit(&agent);
+
+    double seconds = TimerSeconds(result.time);
+    double rate = (seconds > 0) ? result.nodes / seconds : 0;
+    if (threads == 1) {
+      baseRate = rate;
+      baseSeconds = seconds;
+      baseNodes = result.nodes;
+    }
+
+    if (options->depth) {
+      printf("%7u  %5d  %11llu  %9.3f  %13.0f  %6.2fx  %7.1f%%\n", threads, result.depth, result.nodes,
+             seconds, rate, (seconds > 0) ? baseSeconds / seconds : 0.0,
+             (baseNodes) ? 100.0 * ((double)result.nodes / baseNodes - 1) : 0.0);
+    } else {
+      printf("%7u  %5d  %11llu  %13.0f  %6.2fx\n", threads, result.depth, result.nodes, rate,
+             (baseRate > 0) ? rate / baseRate : 0.0);
+    }
+  }
+
+  return 0;
+}
+
+
+/**
+ * @brief Splits the board into independent regions and solves it with the
+ * endgame solver. With check the position is also searched to the end
+ * with negamax and the two have to agree on who wins.
+ *
+ * @return 0 if the solver and the search agree
+ */
+int EndgameMain(Arena *arena, const char *boardFilePath, PlayerKind player, Bool check) {
+  BitBoard board = BitBoardFromFile(arena, boardFilePath);
+
+  U64 regions[ENDGAME_MAX_REGIONS], walls;
+  U32 count = EndgameRegions(board, regions, &walls);
+  printf("Walls: %u stones\nRegions: %u\n", PopCount(walls), count);
+  for (U32 i = 0; i < count; i++) {
+    printf("  %u stones, %u movable\n", PopCount(regions[i]),
+           PopCount((MovablePieces(board, PlayerKind_White) | MovablePieces(board, PlayerKind_Black)) & regions[i]));
+  }
+
+  Arena *endgameArena = ArenaInit(Megabyte(ENDGAME_DEFAULT_MEGABYTES) + Megabyte(1));
+  Endgame *endgame = EndgameInit(endgameArena, ENDGAME_DEFAULT_MEGABYTES);
+  Move move;
+  U64 start = TimerNow();
+  EndgameOutcome outcome = EndgameSolve(endgame, board, player, ~0llu, &move);
+  double seconds = TimerSeconds(TimerNow() - start);
+  const char *outcomeText[] = { "unknown", "win", "loss" };
+  char text[MOVE_LENGTH] = "none";
+  if (move != MOVE_NONE) MoveToText(move, text);
+  printf("\nOutcome: %s\nMove: %s\nGames: %u\nTime: %.3f seconds\n",
+         outcomeText[outcome], text, endgame->games->gameCount, seconds);
+  ArenaDeinit(endgameArena);
+
+  if (!check || outcome == EndgameOutcome_Unknown) return 0;
+
+  // The search stops by itself once it sees the forced result, even with
+  // a single move to play
+  TranspositionTable *tt = TTInit(arena, TT_DEFAULT_MEGABYTES);
+  Agent agent = {
+    .player = player,
+    .engine = EngineKind_AlphaBeta,
+    .tt = tt,
+    .depth = 1,
+    .moveTime = 1000llu * 60 * 60,
+    .solve = Bool_True,
+  };
+  AgentThreadsInit(&agent, arena, 1);
+  SearchResult result;
+  AgentSearch(&agent, board, &result);
+  AgentThreadsDeinit(&agent);
+
+  // With no moves at all the search has lost without scoring anything
+  Bool searchWin = result.rootMoves.count && ScoreIsWin(result.scores[0]);
+  Bool searchLoss = !result.rootMoves.count || ScoreIsLoss(result.scores[0]);
+  printf("\nSearch: %s at depth %d in %.3f seconds\n", (searchWin) ? "win" : (searchLoss) ? "loss" : "unresolved",
+         result.depth, TimerSeconds(result.time));
+  if (!searchWin && !searchLoss) {
+    printf("Nothing to compare\n");
+    return 0;
+  }
+  Bool agree = searchWin == (outcome == EndgameOutcome_Win);
+  printf("%s\n", (agree) ? "OK" : "FAILED");
+  return (agree) ? 0 : 1;
+}
+
+
+static U64 treeBenchBuildStateNodes(StateNodePool *pool, StateNode *node, PlayerKind player, U32 depth, U64 *count) {
+  if (!depth) return 0;
+  StateNodeGenerateChildren(pool, node, player, count);
+  for (StateNode *child = node->firstChild; child; child = child->next) {
+    treeBenchBuildStateNodes(pool, child, PlayerOpponent(player), depth - 1, count);
+  }
+  return *count;
+}
+
+static U64 treeBenchWalkStateNodes(StateNode *node) {
+  U64 sum = node->board.whole;
+  for (StateNode *child = node->firstChild; child; child = child->next) sum += treeBenchWalkStateNodes(child);
+  return sum;
+}
+
+static Bool treeBenchBuildTreeNodes(TreePool *pool, TreeIndex index, PlayerKind player, U32 depth) {
+  if (!depth) return Bool_True;
+  if (!TreeNodeExpand(pool, index, player)) return Bool_False;
+  TreeNode *node = TreeNodeGet(pool, index);
+  for (U32 i = 0; i < node->childCount; i++) {
+    if (!treeBenchBuildTreeNodes(pool, node->firstChild + i, PlayerOpponent(player), depth - 1)) return Bool_False;
+  }
+  return Bool_True;
+}
+
+static U64 treeBenchWalkTreeNodes(TreePool *pool, TreeIndex index) {
+  TreeNode *node = TreeNodeGet(pool, index);
+  U64 sum = node->board;
+  for (U32 i = 0; i < node->childCount; i++) sum += treeBenchWalkTreeNodes(pool, node->firstChild + i);
+  return sum;
+}
+
+
+/**
+ * @brief Builds every position depth plies from the board as a tree twice,
+ * once with the old pointer linked StateNodes and once in a TreePool, and
+ * prints the memory each takes and how long building and walking them
+ * takes. Both walks add up every board so they can be checked against
+ * each other.
+ *
+ * @return 0 if both trees hold the same positions
+ */
+int TreeBenchMain(Arena *arena, const char *boardFilePath, PlayerKind player, U32 depth) {
+  BitBoard board = BitBoardFromFile(arena, boardFilePath);
+
+  StateNodePool *statePool = StateNodePoolInit(arena);
+  StateNode *stateRoot = StateNodePoolAlloc(statePool);
+  stateRoot->board = board;
+  U64 stateCount = 1;
+  U64 start = TimerNow();
+  treeBenchBuildStateNodes(statePool, stateRoot, player, depth, &stateCount);
+  double stateBuild = TimerSeconds(TimerNow() - start);
+  start = TimerNow();
+  U64 stateSum = treeBenchWalkStateNodes(stateRoot);
+  double stateWalk = TimerSeconds(TimerNow() - start);
+
+  Arena *treeArena = ArenaInit(Megabyte(TREE_DEFAULT_MEGABYTES) + Megabyte(1));
+  TreePool *treePool = TreePoolInit(treeArena, TREE_DEFAULT_MEGABYTES);
+  TreeIndex treeRoot = TreeNodeAlloc(treePool, board);
+  start = TimerNow();
+  Bool built = treeBenchBuildTreeNodes(treePool, treeRoot, player, depth);
+  double treeBuild = TimerSeconds(TimerNow() - start);
+  start = TimerNow();
+  U64 treeSum = treeBenchWalkTreeNodes(treePool, treeRoot);
+  double treeWalk = TimerSeconds(TimerNow() - start);
+  U64 treeCount = treePool->used;
+  AllocStats treeStats = treePool->stats;
+  ArenaDeinit(treeArena);
+
+  if (!built) {
+    printf("The tree pool filled up, try a smaller depth\n");
+    return 1;
+  }
+
+  printf("layout     bytes/node        nodes  megabytes  build seconds  walk seconds  walk nodes/second\n");
+  printf("StateNode  %10llu  %11llu  %9.1f  %13.3f  %12.3f  %17.0f\n", (U64)sizeof(StateNode), stateCount,
+         (double)stateCount * sizeof(StateNode) / Megabyte(1), stateBuild, stateWalk,
+         (stateWalk > 0) ? stateCount / stateWalk : 0.0);
+  printf("TreeNode   %10llu  %11llu  %9.1f  %13.3f  %12.3f  %17.0f\n", (U64)sizeof(TreeNode), treeCount,
+         (double)treeCount * sizeof(TreeNode) / Megabyte(1), treeBuild, treeWalk,
+         (treeWalk > 0) ? treeCount / treeWalk : 0.0);
+  AllocStats stateStats = StateNodePoolStats(statePool);
+  printf("\n");
+  AllocStatsPrint(stdout, "StateNode", &stateStats);
+  AllocStatsPrint(stdout, "TreeNode", &treeStats);
+
+  Bool agree = stateCount == treeCount && stateSum == treeSum;
+  printf("%s\n", (agree) ? "OK" : "FAILED");
+  return (agree) ? 0 : 1;
+}
+
+
+/**
+ * @brief Counts the positions depth plies from the board with the fast
+ * generator, printing the count under each root move. Unless check is off
+ * the count is repeated with the old per square generator and every root
+ * move is compared.
+ * 
+ * @return 0 if both generators agree
+ */
+int PerftMain(Arena *arena, const char *boardFilePath, PlayerKind player, U32 depth, Bool check) {
+  BitBoard board = BitBoardFromFile(arena, boardFilePath);
+  PlayerKind opponent = PlayerOpponent(player);
+  if (depth == 0) {
+    printf("Nodes: 1\n");
+    return 0;
+  }
+
+  MoveList rootMoves;
+  GenerateMoves(board, player, &rootMoves);
+  U64 perMove[MAX_MOVES];
+  U64 total = 0;
+
+  U64 start = TimerNow();
+  for (U32 i = 0; i < rootMoves.count; i++) {
+    BitBoard child = { .whole = board.whole ^ MoveMask(rootMoves.moves[i]) };
+    perMove[i] = Perft(child, opponent, depth - 1);
+    total += perMove[i];
+  }
+  double seconds = TimerSeconds(TimerNow() - start);
+
+  for (U32 i = 0; i < rootMoves.count; i++) {
+    char text[MOVE_LENGTH];
+    MoveToText(rootMoves.moves[i], text);
+    printf("%s: %llu\n", text, perMove[i]);
+  }
+  printf("\nMoves: %u\nNodes: %llu\nTime: %.3f seconds\nNodes/second: %.0f\n",
+         rootMoves.count, total, seconds, (seconds > 0) ? total / seconds : 0.0);
+
+  if (!check) return 0;
+
+  // Same count again with the reference generator
+  StateNodePool *pool = StateNodePoolInit(arena);
+  StateNode *root = StateNodePoolAlloc(pool);
+  root->board = board;
+  U64 statesCreated = 0;
+  StateNodeGenerateChildrenReference(pool, root, player, &statesCreated);
+
+  U32 mismatches = 0;
+  U64 referenceTotal = 0;
+  start = TimerNow();
+  for (StateNode *child = root->firstChild; child; child = child->next) {
+    U64 nodes = PerftReference(pool, child, opponent, depth - 1);
+    referenceTotal += nodes;
+
+    Bool found = Bool_False;
+    for (U32 i = 0; i < rootMoves.count; i++) {
+      char text[MOVE_LENGTH];
+      MoveToText(rootMoves.moves[i], text);
+      if (strcmp(text, child->move)) continue;
+      found = Bool_True;
+      if (perMove[i] != nodes) {
+        printf("MISMATCH %s: fast %llu reference %llu\n", text, perMove[i], nodes);
+        mismatches++;
+      }
+    }
+    if (!found) {
+      printf("MISMATCH %s: missing from the fast generator\n", child->move);
+      mismatches++;
+    }
+  }
+  double referenceSeconds = TimerSeconds(TimerNow() - start);
+
+  if (statesCreated != rootMoves.count) {
+    printf("MISMATCH root moves: fast %u reference %llu\n", rootMoves.count, statesCreated);
+    mismatches++;
+  }
+
+  printf("\nReference nodes: %llu\nReference time: %.3f seconds\nReference nodes/second: %.0f\n",
+         referenceTotal, referenceSeconds, (referenceSeconds > 0) ? referenceTotal / referenceSeconds : 0.0);
+  printf("%s\n", (mismatches) ? "FAILED" : "OK");
+
+  return (mismatches) ? 1 : 0;
+}
+
 int main(int argc, char** argv) {
   
   Bool gaming = Bool_True;
   char *boardFilePath = NULL;
+  Options options = {
+    .engine = EngineKind_AlphaBeta,
+    .hashMegabytes = TT_DEFAULT_MEGABYTES,
+    .moveTime = DEFAULT_MOVE_TIME,
+    .threads = 1,
+    .endgamePieces = ENDGAME_MOVABLE_PIECES,
+  };
   
-  FILE *dump = fopen("dump.txt", "w");
+  if (argc > 1 && !strcmp(argv[1], "perft")) {
+    if (argc < 5 || argc > 6 || (argc == 6 && strcmp(argv[5], "--no-check"))) {
+      PrintUsage();
+      return -1;
+    }
+    Arena *arena = ArenaInit(Gigabyte(4));
+    PlayerKind player = (*argv[3] == 'W') ? PlayerKind_White : PlayerKind_Black;
+    int result = PerftMain(arena, argv[2], player, atoi(argv[4]), argc == 5);
+    ArenaDeinit(arena);
+    return result;
+  }
 
-  if (argc > 3) {
+  if (argc > 1 && !strcmp(argv[1], "treebench")) {
+    if (argc != 5) {
+      PrintUsage();
+      return -1;
+    }
+    Arena *arena = ArenaInit(Gigabyte(4));
+    PlayerKind player = (*argv[3] == 'W') ? PlayerKind_White : PlayerKind_Black;
+    int result = TreeBenchMain(arena, argv[2], player, atoi(argv[4]));
+    ArenaDeinit(arena);
+    return result;
+  }
+
+  if (argc > 1 && !strcmp(argv[1], "endgame")) {
+    if (argc < 4 || argc > 5 || (argc == 5 && strcmp(argv[4], "--no-check"))) {
+      PrintUsage();
+      return -1;
+    }
+    ZobristInit();
+    Arena *arena = ArenaInit(Megabyte(TT_DEFAULT_MEGABYTES) + Megabyte(16));
+    PlayerKind player = (*argv[3] == 'W') ? PlayerKind_White : PlayerKind_Black;
+    int result = EndgameMain(arena, argv[2], player, argc == 4);
+    ArenaDeinit(arena);
+    return result;
+  }
+
+  if (argc > 1 && !strcmp(argv[1], "bench")) {
+    options.threads = ThreadCountOnline();
+    if (argc < 4 || !ParseOptions(argc, argv, 4, &options)) {
+      PrintUsage();
+      return -1;
+    }
+    if (!LoadTablebase(&options)) return -1;
+    ZobristInit();
+    Arena *arena = ArenaInit(Megabyte(options.hashMegabytes) + Megabyte(16));
+    PlayerKind player = (*argv[3] == 'W') ? PlayerKind_White : PlayerKind_Black;
+    int result = BenchMain(arena, argv[2], player, &options);
+    ArenaDeinit(arena);
+    TablebaseUnload();
+    return result;
+  }
+
+  if (argc < 3) {
     printf("Dude, you got to use this thing properly\n");
+    PrintUsage();
     return -1;  
   } else {
     boardFilePath = argv[1];
     
   }
 
-  Arena *arena = ArenaInit(Gigabyte(4)); // Don't worry this won't actually allocate 4 gigabytes
+  if (!ParseOptions(argc, argv, 3, &options)) return -1;
+  if (!LoadTablebase(&options)) return -1;
+  if (!LoadBook(&options)) return -1;
+
+  FILE *dump = fopen("dump.txt", "w");
+
+  // Appended to, so one file can hold a whole match
+  FILE *telemetry = NULL;
+  if (options.telemetryPath) {
+    telemetry = (!strcmp(options.telemetryPath, "-")) ? stderr : fopen(options.telemetryPath, "a");
+    if (!telemetry) {
+      printf("Could not open telemetry file \"%s\"\n", options.telemetryPath);
+      return -1;
+    }
+  }
+
+  Arena *arena = ArenaInit(Gigabyte(4)); // only reserves the address space, pages are committed as it grows
 
   BitBoard board = BitBoardFromFile(arena, boardFilePath);
 
   U8 agentPlayer = (*argv[2] == 'W') ?  PlayerKind_White : PlayerKind_Black;
-  U64 playerBoard = (agentPlayer == PlayerKind_White) ? board.whole & allWhite : board.whole & allBlack;
-  U64 allPlayerBoard = (agentPlayer == PlayerKind_White) ? allWhite : allBlack;
   U8 agentOpponent = (agentPlayer == PlayerKind_White) ? PlayerKind_Black : PlayerKind_White;
 
   srand(time(NULL));
   
-  StateNodePool* stateNodePool = StateNodePoolInit(arena);
+  TreePool *treePool = (options.engine == EngineKind_Tree) ? TreePoolInit(arena, TREE_DEFAULT_MEGABYTES) : NULL;
+  MctsTree *mctsTree = (options.engine == EngineKind_Mcts) ? MctsTreeInit(arena, MCTS_DEFAULT_MEGABYTES) : NULL;
+
+  // The table and the search threads live as long as the agent and are
+  // sized from --hash, so they get an arena of their own instead of
+  // sharing the main one with the board and the engine's pool
+  ZobristInit();
+  Arena *agentArena = ArenaInit(Megabyte(options.hashMegabytes) + Megabyte(1));
+  TranspositionTable *tt = TTInit(agentArena, options.hashMegabytes);
+  Arena *endgameArena = (options.endgamePieces) ? ArenaInit(Megabyte(ENDGAME_DEFAULT_MEGABYTES) + Megabyte(1)) : NULL;
+  Endgame *endgame = (endgameArena) ? EndgameInit(endgameArena, ENDGAME_DEFAULT_MEGABYTES) : NULL;
+
   bool blackIsAgent = (agentPlayer == PlayerKind_White) ? false : true;
   int turns = 1;
   
-  int depth = 1;
+  Agent agent = {
+    .player = agentPlayer,
+    .engine = options.engine,
+    .tree = treePool,
+    .mcts = mctsTree,
+    .tt = tt,
+    .depth = 1,
+    .moveTime = options.moveTime,
+    .endgame = endgame,
+    .endgamePieces = options.endgamePieces,
+    .ponder = options.ponder,
+    .telemetry = telemetry,
+    .printMemory = options.memory,
+  };
+  AgentThreadsInit(&agent, agentArena, options.threads);
+
   while (gaming) {
     if (blackIsAgent) {
-      agentMove(agentPlayer, &board, stateNodePool, depth);
+      agentMove(&agent, &board);
       // agent
       // input()
       printBoardToConsole(&board);
+      AgentPonderStart(&agent, board);
       mainInput(&board, agentOpponent);
+      AgentPonderStop(&agent, board);
       printBoardToConsole(&board);
     }
 
@@ -156,9 +662,11 @@ int main(int argc, char** argv) {
 
       // Somehow this fixes drivercheck
       
-      agentMove(agentPlayer, &board, stateNodePool, depth);
+      agentMove(&agent, &board);
       printBoardToConsole(&board);
+      AgentPonderStart(&agent, board);
       mainInput(&board, agentOpponent);
+      AgentPonderStop(&agent, board);
       printBoardToConsole(&board);
     }
 
@@ -170,8 +678,14 @@ int main(int argc, char** argv) {
   BitBoardFilePrint(dump, board);
 
   // deinitalization
+  AgentThreadsDeinit(&agent);
+  ArenaDeinit(agentArena);
+  if (endgameArena) ArenaDeinit(endgameArena);
   ArenaDeinit(arena);
+  TablebaseUnload();
+  BookUnload();
 
   fclose(dump);
+  if (telemetry && telemetry != stderr) fclose(telemetry);
   return 0;
 }
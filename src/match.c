@@ -0,0 +1,403 @@
+/*
+  USAGE:
+    match.c plays engines against each other to see whether a change made
+    the agent stronger. Like bookgen.c it is its own program:
+
+    make match
+    ./match.exe <engine> <engine> [--games N] [--time MS | --nodes N | --depth D]
+                [--threads T] [--plies P] [--sprt ELO0 ELO1] [--hash MB] [--endgame PIECES] [--seed S]
+                [--record FILE]
+
+    An engine is ab, ybwc, mcts or random, which plays any legal move.
+    Games come in pairs: both start from the same opening of random
+    moves and the engines swap colours between them. Each thread plays
+    its own games with one search thread per agent, so a match uses every
+    core without the agents fighting over them. With one thread ybwc never
+    splits, so it plays exactly like ab here. The results are from the
+    first engine's point of view. With --sprt the match stops as soon as
+    the sequential probability ratio test can tell whether the first
+    engine is ELO0 or ELO1 stronger than the second.
+
+    --nodes and --depth do not apply to mcts, which always thinks for
+    --time. The tree engine is not offered, its node pool is too big to give every game one.
+    Everything the agents print goes to /dev/null, they are never given
+    --memory or --telemetry so nothing goes to stderr.
+
+    --record writes every position played after the opening, with who
+    won the game, as the labelled positions tune.exe learns from (see
+    eval.h). Fast games are enough for that, --depth 4 --endgame 0 plays
+    thousands a minute. An engine against itself at a fixed depth plays
+    both games of a pair the same, only the first of those is written.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "transposition.h"
+#include "threadpool.h"
+#include "endgame.h"
+#include "tablebase.h"
+#include "agent.h"
+#include "book.h"
+#include "eval.h"
+#include "timer.h"
+
+#define MATCH_DEFAULT_GAMES 200
+#define MATCH_DEFAULT_MOVE_TIME 100 // milliseconds
+#define MATCH_DEFAULT_PLIES 6 // random moves at the start of a pair, the two removals included
+#define MATCH_HASH_MEGABYTES 16 // per agent, there are two per thread
+#define MATCH_MCTS_MEGABYTES 128
+#define MATCH_REPORT_GAMES 10 // games between progress lines
+#define SPRT_ALPHA 0.05
+#define SPRT_BETA 0.05
+
+typedef struct MatchPlayer MatchPlayer;
+struct MatchPlayer {
+  Bool random; // plays any legal move, agent is not used
+  Agent agent;
+};
+
+typedef struct Match Match;
+struct Match {
+  const char *names[2];
+  Bool random[2];
+  EngineKind engines[2];
+  U32 games;
+  U32 plies;
+  U64 moveTime;
+  U64 maxNodes;
+  int maxDepth;
+  U64 hashMegabytes;
+  U32 endgamePieces;
+  U64 seed;
+  Bool sprt;
+  double elo0;
+  double elo1;
+  FILE *out;
+  FILE *record; // labelled positions, NULL if not wanted
+  Bool repeats; // both games of a pair are the same
+
+  U32 nextGame; // taken with an atomic add
+  Bool stop; // set once the SPRT has decided
+
+  pthread_mutex_t lock; // everything below
+  U32 played;
+  U32 wins;
+  U32 playedAsBlack;
+  U32 winsAsBlack;
+  U64 recorded; // positions written to record
+  U64 start;
+};
+
+
+// splitmix64, the opening of a pair only depends on the seed and the pair
+static U64 matchRandom(U64 *state) {
+  U64 x = (*state += 0x9E3779B97F4A7C15llu);
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9llu;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBllu;
+  return x ^ (x >> 31);
+}
+
+
+static BitBoard matchPlay(BitBoard board, Move move) {
+  board.whole ^= (MoveIsRemoval(move)) ? 1llu << MoveFrom(move) : MoveMask(move);
+  return board;
+}
+
+
+// Everything the side to move may play, false if it has lost
+static Bool matchMoves(BitBoard board, PlayerKind player, MoveList *list) {
+  return OpeningRemovals(board, player, list) || GenerateMoves(board, player, list);
+}
+
+
+// Black takes the first stone off a full board
+static void matchOpening(Match *match, U32 pair, BitBoard *board, PlayerKind *player) {
+  U64 rng = match->seed ^ (0xD1B54A32D192ED03llu * (pair + 1));
+  *board = (BitBoard){ .whole = ~0llu };
+  *player = PlayerKind_Black;
+
+  MoveList list;
+  for (U32 ply = 0; ply < match->plies && matchMoves(*board, *player, &list); ply++) {
+    *board = matchPlay(*board, list.moves[matchRandom(&rng) % list.count]);
+    *player = PlayerOpponent(*player);
+  }
+}
+
+
+static void matchPlayerInit(Match *match, MatchPlayer *player, U32 side, Arena *arena) {
+  player->random = match->random[side];
+  if (player->random) return;
+
+  EngineKind engine = match->engines[side];
+  player->agent = (Agent){
+    .engine = engine,
+    .mcts = (engine == EngineKind_Mcts) ? MctsTreeInit(arena, MATCH_MCTS_MEGABYTES) : NULL,
+    .tt = TTInit(arena, match->hashMegabytes),
+    .depth = 1,
+    .maxDepth = match->maxDepth,
+    .maxNodes = match->maxNodes,
+    .moveTime = match->moveTime,
+    .endgame = (match->endgamePieces) ? EndgameInit(arena, ENDGAME_DEFAULT_MEGABYTES) : NULL,
+    .endgamePieces = match->endgamePieces,
+  };
+  AgentThreadsInit(&player->agent, arena, 1);
+}
+
+
+// Returns the winner, the side to move loses once it has no move. Every
+// position a move is played in goes in positions unless it is NULL, it
+// has to hold MAX_PLY.
+static PlayerKind matchPlayGame(MatchPlayer *black, MatchPlayer *white, BitBoard board, PlayerKind player, U64 *rng,
+                                PositionEntry *positions, U32 *positionCount) {
+  MoveList list;
+  while (matchMoves(board, player, &list)) {
+    if (positions && *positionCount < MAX_PLY) {
+      positions[(*positionCount)++] = (PositionEntry){
+        .board = board.whole,
+        .player = player,
+      };
+    }
+    MatchPlayer *mover = (player == PlayerKind_Black) ? black : white;
+    if (mover->random) {
+      board = matchPlay(board, list.moves[matchRandom(rng) % list.count]);
+    } else {
+      BitBoard before = board;
+      mover->agent.player = player;
+      agentMove(&mover->agent, &board);
+      if (board.whole == before.whole) break; // gave up
+    }
+    player = PlayerOpponent(player);
+  }
+  return PlayerOpponent(player);
+}
+
+
+// Elo difference that scores score on average, written into text. At 0
+// or 1 and past them there is no finite difference, that is -inf or +inf.
+static void eloFromScore(double score, char *text, U32 size) {
+  if (score <= 0) snprintf(text, size, "-inf");
+  else if (score >= 1) snprintf(text, size, "+inf");
+  else snprintf(text, size, "%+.0f", -400.0 * log10(1.0 / score - 1.0) + 0.0); // no -0
+}
+
+
+// Log likelihood ratio of elo1 against elo0, there are no draws in Konane
+static double sprtLogLikelihoodRatio(Match *match) {
+  double p0 = 1.0 / (1.0 + pow(10.0, -match->elo0 / 400.0));
+  double p1 = 1.0 / (1.0 + pow(10.0, -match->elo1 / 400.0));
+  U32 losses = match->played - match->wins;
+  return match->wins * log(p1 / p0) + losses * log((1.0 - p1) / (1.0 - p0));
+}
+
+
+// match->lock must be held
+static void matchReport(Match *match) {
+  U32 played = match->played;
+  double score = (double)match->wins / played;
+  double error = 1.96 * sqrt(score * (1.0 - score) / played); // 95%
+  char elo[16], low[16], high[16];
+  eloFromScore(score, elo, sizeof(elo));
+  eloFromScore(score - error, low, sizeof(low));
+  eloFromScore(score + error, high, sizeof(high));
+  fprintf(match->out, "%5u games  %s %u - %u %s  (%.1f%%, %.1f%% as black)  Elo %s",
+          played, match->names[0], match->wins, played - match->wins, match->names[1], 100.0 * score,
+          (match->playedAsBlack) ? 100.0 * match->winsAsBlack / match->playedAsBlack : 0.0, elo);
+  // Without a win or without a loss the interval says nothing
+  if (match->wins && match->wins < played) fprintf(match->out, " [%s, %s]", low, high);
+  if (match->sprt) {
+    fprintf(match->out, "  LLR %.2f [%.2f, %.2f]", sprtLogLikelihoodRatio(match),
+            log(SPRT_BETA / (1.0 - SPRT_ALPHA)), log((1.0 - SPRT_BETA) / SPRT_ALPHA));
+  }
+  fprintf(match->out, "  %.0f s\n", TimerSeconds(TimerNow() - match->start));
+}
+
+
+static void matchRecord(Match *match, Bool won, Bool asBlack, PositionEntry *positions, U32 positionCount) {
+  pthread_mutex_lock(&match->lock);
+  if (match->record) match->recorded += fwrite(positions, sizeof(PositionEntry), positionCount, match->record);
+  match->played++;
+  match->wins += won;
+  match->playedAsBlack += asBlack;
+  match->winsAsBlack += won && asBlack;
+
+  Bool decided = Bool_False;
+  if (match->sprt) {
+    double llr = sprtLogLikelihoodRatio(match);
+    decided = llr <= log(SPRT_BETA / (1.0 - SPRT_ALPHA)) || llr >= log((1.0 - SPRT_BETA) / SPRT_ALPHA);
+  }
+  if (decided && !match->stop) {
+    __atomic_store_n(&match->stop, Bool_True, __ATOMIC_RELAXED);
+    matchReport(match);
+    Bool better = sprtLogLikelihoodRatio(match) > 0;
+    fprintf(match->out, "SPRT: %s is %+.0f Elo or %s against %s\n", match->names[0],
+            (better) ? match->elo1 : match->elo0, (better) ? "better" : "worse", match->names[1]);
+  } else if (!(match->played % MATCH_REPORT_GAMES) || match->played == match->games) {
+    matchReport(match);
+  }
+  pthread_mutex_unlock(&match->lock);
+}
+
+
+// Every thread has its own pair of agents and takes games until there are none left
+static void matchJob(void *data, U32 threadIndex) {
+  Match *match = data;
+  Arena *arena = ArenaInit(2 * (Megabyte(match->hashMegabytes) + Megabyte(ENDGAME_DEFAULT_MEGABYTES) +
+                                Megabyte(MATCH_MCTS_MEGABYTES)) + Megabyte(16));
+  MatchPlayer players[2];
+  for (U32 side = 0; side < 2; side++) matchPlayerInit(match, &players[side], side, arena);
+  U64 rng = match->seed ^ (0x2545F4914F6CDD1Dllu * (threadIndex + 1));
+
+  while (!__atomic_load_n(&match->stop, __ATOMIC_RELAXED)) {
+    U32 game = __atomic_fetch_add(&match->nextGame, 1, __ATOMIC_RELAXED);
+    if (game >= match->games) break;
+
+    BitBoard board;
+    PlayerKind player;
+    matchOpening(match, game / 2, &board, &player);
+    for (U32 side = 0; side < 2; side++) {
+      if (!players[side].random) TTClear(players[side].agent.tt);
+    }
+
+    // The first engine is black in even games
+    Bool firstIsBlack = !(game & 1);
+    MatchPlayer *black = &players[(firstIsBlack) ? 0 : 1];
+    MatchPlayer *white = &players[(firstIsBlack) ? 1 : 0];
+    PositionEntry positions[MAX_PLY];
+    U32 positionCount = 0;
+    Bool record = match->record && !(match->repeats && (game & 1));
+    PlayerKind winner = matchPlayGame(black, white, board, player, &rng, (record) ? positions : NULL, &positionCount);
+    for (U32 i = 0; i < positionCount; i++) positions[i].winner = winner;
+    matchRecord(match, (winner == PlayerKind_Black) == firstIsBlack, firstIsBlack, positions, positionCount);
+  }
+
+  for (U32 side = 0; side < 2; side++) {
+    if (!players[side].random) AgentThreadsDeinit(&players[side].agent);
+  }
+  ArenaDeinit(arena);
+}
+
+
+static Bool matchParseEngine(Match *match, U32 side, const char *name) {
+  match->names[side] = name;
+  match->random[side] = Bool_False;
+  if (!strcmp(name, "ab")) match->engines[side] = EngineKind_AlphaBeta;
+  else if (!strcmp(name, "ybwc")) match->engines[side] = EngineKind_Ybwc;
+  else if (!strcmp(name, "mcts")) match->engines[side] = EngineKind_Mcts;
+  else if (!strcmp(name, "random")) match->random[side] = Bool_True;
+  else return Bool_False;
+  return Bool_True;
+}
+
+
+int main(int argc, char **argv) {
+  Match match = {
+    .games = MATCH_DEFAULT_GAMES,
+    .plies = MATCH_DEFAULT_PLIES,
+    .moveTime = MATCH_DEFAULT_MOVE_TIME,
+    .hashMegabytes = MATCH_HASH_MEGABYTES,
+    .endgamePieces = ENDGAME_MOVABLE_PIECES,
+    .seed = (U64)time(NULL),
+  };
+  U32 threads = ThreadCountOnline();
+  const char *recordPath = NULL;
+
+  Bool ok = argc >= 3 && matchParseEngine(&match, 0, argv[1]) && matchParseEngine(&match, 1, argv[2]);
+  for (int i = 3; ok && i < argc; i++) {
+    if (!strcmp(argv[i], "--games") && i + 1 < argc) match.games = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--time") && i + 1 < argc) match.moveTime = strtoull(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--nodes") && i + 1 < argc) match.maxNodes = strtoull(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--depth") && i + 1 < argc) match.maxDepth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--plies") && i + 1 < argc) match.plies = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--hash") && i + 1 < argc) match.hashMegabytes = strtoull(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--endgame") && i + 1 < argc) match.endgamePieces = max(atoi(argv[++i]), 0);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) match.seed = strtoull(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--record") && i + 1 < argc) recordPath = argv[++i];
+    else if (!strcmp(argv[i], "--sprt") && i + 2 < argc) {
+      match.sprt = Bool_True;
+      match.elo0 = atof(argv[++i]);
+      match.elo1 = atof(argv[++i]);
+      ok = match.elo0 < match.elo1;
+    }
+    else ok = Bool_False;
+  }
+  if (!ok) {
+    printf("usage: match.exe <ab|ybwc|mcts|random> <ab|ybwc|mcts|random> [--games N] [--time MS | --nodes N | --depth D]\n");
+    printf("                 [--threads T] [--plies P] [--sprt ELO0 ELO1] [--hash MB] [--endgame PIECES] [--seed S]\n");
+    printf("                 [--record FILE]\n");
+    printf("Agents search on one thread each, so ybwc plays the same as ab\n");
+    return -1;
+  }
+  if (!threads) threads = 1;
+  if (!match.hashMegabytes) match.hashMegabytes = 1;
+  match.games += match.games & 1; // whole pairs
+  // A node or depth limit decides when to stop, the clock is only there
+  // so the endgame solver still gets a budget
+  if (match.maxNodes || match.maxDepth) match.moveTime = DEFAULT_MOVE_TIME;
+  match.repeats = (match.maxNodes || match.maxDepth) && !strcmp(match.names[0], match.names[1]) && !match.random[0] &&
+                  match.engines[0] != EngineKind_Mcts;
+
+  // The report goes to the real stdout, the agents' printing to /dev/null
+  match.out = fdopen(dup(fileno(stdout)), "w");
+  if (!match.out || !freopen("/dev/null", "w", stdout)) {
+    fprintf(stderr, "Could not send the agent's output to /dev/null\n");
+    return -1;
+  }
+  setvbuf(match.out, NULL, _IOLBF, 0);
+
+  // The header is written again with the count at the end
+  PositionsHeader header = { .magic = POSITIONS_MAGIC, .version = POSITIONS_VERSION };
+  if (recordPath) {
+    match.record = fopen(recordPath, "wb");
+    if (!match.record || fwrite(&header, sizeof(header), 1, match.record) != 1) {
+      fprintf(match.out, "Could not write %s\n", recordPath);
+      return -1;
+    }
+  }
+
+  ZobristInit();
+  if (TablebaseLoad(TABLEBASE_DEFAULT_PATH)) fprintf(match.out, "Tablebase %s\n", TABLEBASE_DEFAULT_PATH);
+  if (BookLoad(BOOK_DEFAULT_PATH)) fprintf(match.out, "Opening book %s\n", BOOK_DEFAULT_PATH);
+  fprintf(match.out, "%s against %s, %u games on %u threads, ", match.names[0], match.names[1], match.games, threads);
+  if (match.maxNodes) fprintf(match.out, "%llu nodes", match.maxNodes);
+  else if (match.maxDepth) fprintf(match.out, "depth %d", match.maxDepth);
+  else fprintf(match.out, "%llu ms", match.moveTime);
+  fprintf(match.out, " a move, %u random plies, seed %llu\n", match.plies, match.seed);
+
+  pthread_mutex_init(&match.lock, NULL);
+  match.start = TimerNow();
+  Arena *arena = ArenaInit(Megabyte(1));
+  ThreadPool *pool = (threads > 1) ? ThreadPoolInit(arena, threads - 1) : NULL;
+  if (pool) ThreadPoolStart(pool, matchJob, &match);
+  matchJob(&match, 0);
+  if (pool) {
+    ThreadPoolWait(pool);
+    ThreadPoolDeinit(pool);
+  }
+  ArenaDeinit(arena);
+  pthread_mutex_destroy(&match.lock);
+
+  if (match.record) {
+    header.count = match.recorded;
+    fseek(match.record, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, match.record);
+    fclose(match.record);
+    fprintf(match.out, "%llu positions written to %s\n", match.recorded, recordPath);
+  }
+
+  TablebaseUnload();
+  BookUnload();
+  fclose(match.out);
+  return 0;
+}
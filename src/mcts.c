@@ -0,0 +1,187 @@
+#include <math.h>
+#include "mcts.h"
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "threadpool.h"
+#include "timer.h"
+
+#define MCTS_MAX_NODES (1u << 31) // leaves room for every thread's add past the end
+
+
+MctsTree *MctsTreeInit(Arena *arena, U64 megabytes) {
+  MctsTree *tree = ArenaPush(arena, sizeof(MctsTree));
+  U64 capacity = Megabyte(megabytes) / sizeof(MctsNode);
+  tree->capacity = (capacity > MCTS_MAX_NODES) ? MCTS_MAX_NODES : (U32)capacity;
+  tree->nodes = ArenaPushNoZero(arena, (U64)tree->capacity * sizeof(MctsNode));
+  return tree;
+}
+
+
+// xorshift64*, every thread has its own state
+static inline U64 mctsRandom(U64 *state) {
+  U64 x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1Dllu;
+}
+
+
+// Random moves until someone can not move, returns who won
+static PlayerKind mctsPlayout(BitBoard board, PlayerKind player, U64 *rng) {
+  MoveList list;
+  while (GenerateMoves(board, player, &list)) {
+    board.whole ^= MoveMask(list.moves[mctsRandom(rng) % list.count]);
+    player = PlayerOpponent(player);
+  }
+  return PlayerOpponent(player);
+}
+
+
+/*
+ * Only the thread that moves the node from leaf to expanding writes its
+ * children, the rest play out from it in the meantime. If the tree is
+ * full the node stays expanding, so it is never tried again.
+ */
+static Bool mctsExpand(MctsTree *tree, MctsNode *node, PlayerKind player) {
+  MctsState leaf = MctsState_Leaf;
+  if (!__atomic_compare_exchange_n(&node->state, &leaf, MctsState_Expanding, Bool_False,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return Bool_False;
+  }
+
+  MoveList list;
+  BitBoard board = { .whole = node->board };
+  GenerateMoves(board, player, &list);
+  // Looking first keeps a full tree from counting on past the end
+  if (__atomic_load_n(&tree->count, __ATOMIC_RELAXED) + list.count > tree->capacity) return Bool_False;
+  U32 first = __atomic_fetch_add(&tree->count, list.count, __ATOMIC_RELAXED);
+  if (first + list.count > tree->capacity) return Bool_False;
+
+  for (U32 i = 0; i < list.count; i++) {
+    tree->nodes[first + i] = (MctsNode){ .board = node->board ^ MoveMask(list.moves[i]) };
+  }
+  node->firstChild = first;
+  node->childCount = list.count;
+  __atomic_store_n(&node->state, MctsState_Expanded, __ATOMIC_RELEASE);
+  return Bool_True;
+}
+
+
+// UCT: the child's win rate plus ROOT2 * sqrt(ln(parent visits) / visits).
+// Children no one has been to yet come first.
+static MctsNode *mctsSelect(MctsTree *tree, MctsNode *node) {
+  float logVisits = logf((float)__atomic_load_n(&node->visits, __ATOMIC_RELAXED) + 1);
+  MctsNode *best = NULL;
+  float bestValue = -1;
+
+  for (U32 i = 0; i < node->childCount; i++) {
+    MctsNode *child = &tree->nodes[node->firstChild + i];
+    U32 visits = __atomic_load_n(&child->visits, __ATOMIC_RELAXED);
+    if (!visits) return child;
+
+    U32 wins = __atomic_load_n(&child->wins, __ATOMIC_RELAXED);
+    float value = (float)wins / visits + ROOT2 * sqrtf(logVisits / visits);
+    if (value > bestValue) {
+      bestValue = value;
+      best = child;
+    }
+  }
+
+  return best;
+}
+
+
+/*
+ * One playout. Visits are counted on the way down, which is the virtual
+ * loss: until the result is in, the line looks like a loss to the other
+ * threads. On the way back up only the wins are left to add.
+ */
+static void mctsIterate(MctsTree *tree, U64 *rng) {
+  MctsNode *path[MAX_PLY + 1];
+  U32 length = 0;
+  MctsNode *node = &tree->nodes[0];
+  PlayerKind player = tree->player; // to move at node
+  __atomic_add_fetch(&node->visits, 1, __ATOMIC_RELAXED);
+  path[length++] = node;
+
+  for (;;) {
+    MctsState state = __atomic_load_n(&node->state, __ATOMIC_ACQUIRE);
+    if (state == MctsState_Leaf && __atomic_load_n(&node->visits, __ATOMIC_RELAXED) >= MCTS_EXPAND_VISITS &&
+        mctsExpand(tree, node, player)) {
+      state = MctsState_Expanded;
+    }
+    if (state != MctsState_Expanded || !node->childCount) break;
+
+    node = mctsSelect(tree, node);
+    __atomic_add_fetch(&node->visits, 1, __ATOMIC_RELAXED);
+    path[length++] = node;
+    player = PlayerOpponent(player);
+  }
+
+  // An expanded node without children is a lost game for the side to move
+  PlayerKind winner;
+  if (__atomic_load_n(&node->state, __ATOMIC_ACQUIRE) == MctsState_Expanded && !node->childCount) {
+    winner = PlayerOpponent(player);
+  } else {
+    BitBoard board = { .whole = node->board };
+    winner = mctsPlayout(board, player, rng);
+  }
+
+  // The side that moved into path[i] is the one not to move there
+  PlayerKind mover = PlayerOpponent(tree->player);
+  for (U32 i = 0; i < length; i++) {
+    if (winner == mover) __atomic_add_fetch(&path[i]->wins, 1, __ATOMIC_RELAXED);
+    mover = PlayerOpponent(mover);
+  }
+}
+
+
+static void mctsJob(void *data, U32 threadIndex) {
+  MctsTree *tree = data;
+  U64 rng = TimerNow() ^ (0x9E3779B97F4A7C15llu * (threadIndex + 1));
+  if (!rng) rng = 1;
+
+  U64 playouts = 0;
+  while (!__atomic_load_n(&tree->stop, __ATOMIC_RELAXED)) {
+    mctsIterate(tree, &rng);
+    if (!(++playouts & (MCTS_CLOCK_CHECK_PLAYOUTS - 1)) && TimerNow() >= tree->deadline) {
+      __atomic_store_n(&tree->stop, Bool_True, __ATOMIC_RELAXED);
+    }
+  }
+
+  __atomic_add_fetch(&tree->playouts, playouts, __ATOMIC_RELAXED);
+}
+
+
+U64 MctsSearch(MctsTree *tree, ThreadPool *threadPool, BitBoard board, PlayerKind player, U64 deadline, Move *move) {
+  tree->nodes[0] = (MctsNode){ .board = board.whole };
+  tree->count = 1;
+  tree->player = player;
+  tree->deadline = deadline;
+  tree->stop = Bool_False;
+  tree->playouts = 0;
+
+  MctsNode *root = &tree->nodes[0];
+  mctsExpand(tree, root, player);
+  *move = MOVE_NONE;
+  if (!root->childCount) return 0;
+
+  // With one move there is nothing to think about
+  if (root->childCount > 1) {
+    if (threadPool) ThreadPoolStart(threadPool, mctsJob, tree);
+    mctsJob(tree, 0);
+    if (threadPool) ThreadPoolWait(threadPool);
+  }
+
+  // The most visited move is the one the search trusts most
+  MctsNode *best = &tree->nodes[root->firstChild];
+  for (U32 i = 1; i < root->childCount; i++) {
+    MctsNode *child = &tree->nodes[root->firstChild + i];
+    if (child->visits > best->visits) best = child;
+  }
+  *move = MoveFromBoards(root->board, best->board);
+  return tree->playouts;
+}
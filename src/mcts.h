@@ -0,0 +1,71 @@
+/*
+  USAGE:
+    The files mcts.h and mcts.c are the Monte Carlo tree search engine.
+    Every thread walks down the shared tree picking children with UCT,
+    adds a node at the bottom, plays a random game from it and counts the
+    result in every node on the way back up. Visits and wins are counted
+    with atomic adds. A thread adds a visit (a virtual loss) on its way
+    down, so the others spread out over the tree instead of all following
+    the same line.
+
+    MctsTree *tree = MctsTreeInit(arena, MCTS_DEFAULT_MEGABYTES);
+    Move move;
+    MctsSearch(tree, threadPool, board, player, deadline, &move); // threadPool may be NULL
+    MctsNode *root = &tree->nodes[0];
+    for (U32 i = 0; i < root->childCount; i++) tree->nodes[root->firstChild + i] ... // per root move
+
+    The tree is built again for every search. Like TreeNode, nodes link
+    to their children with indices and the children of a node are next to
+    each other.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef MCTS_H
+#define MCTS_H
+
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "threadpool.h"
+
+#define MCTS_DEFAULT_MEGABYTES 1024
+#define MCTS_EXPAND_VISITS 2 // a leaf is expanded on its second visit, the first just plays out
+#define MCTS_CLOCK_CHECK_PLAYOUTS 64 // power of two, playouts between looks at the clock
+
+typedef U8 MctsState;
+enum {
+  MctsState_Leaf,
+  MctsState_Expanding, // one thread is writing the children, the others play out from here
+  MctsState_Expanded,
+};
+
+typedef struct MctsNode MctsNode;
+struct MctsNode {
+  U64 board;
+  U32 firstChild;
+  U8 childCount;
+  MctsState state;
+  U16 unused;
+  U32 visits; // virtual losses included while threads are below this node
+  U32 wins;   // for the side that moved into this node
+};
+
+typedef struct MctsTree MctsTree;
+struct MctsTree {
+  MctsNode *nodes;
+  U32 capacity;
+  U32 count; // taken with an atomic add, index 0 is the root
+
+  // set up by MctsSearch() for the threads
+  PlayerKind player;
+  U64 deadline;
+  Bool stop;
+  U64 playouts;
+};
+
+MctsTree *MctsTreeInit(Arena *arena, U64 megabytes);
+U64 MctsSearch(MctsTree *tree, ThreadPool *threadPool, BitBoard board, PlayerKind player, U64 deadline, Move *move); // returns the playouts, MOVE_NONE if player has no move
+
+#endif
@@ -0,0 +1,353 @@
+#include "movegen.h"
+#include "types.h"
+#include "boardio.h"
+
+// A piece on file index f (0 is H, 7 is A) that jumps k+1 stones towards the
+// A file lands on f + 2(k+1), so it must start far enough from the edge.
+// Checking the start square means shifted bits can never wrap into the next row.
+static const U64 leftRoom[MAX_JUMPS] = {
+  0x3F * FILE_H,
+  0x0F * FILE_H,
+  0x03 * FILE_H,
+};
+
+static const U64 rightRoom[MAX_JUMPS] = {
+  0xFC * FILE_H,
+  0xF0 * FILE_H,
+  0xC0 * FILE_H,
+};
+
+// How far one jump moves a piece in each direction, indexed by Direction_*
+static const I8 jumpStep[4] = { 16, 2, -16, -2 };
+
+
+/*
+ * Directions here are the way the piece travels:
+ * up    - towards row 8 (bit index +8)
+ * left  - towards the A file (bit index +1)
+ * down  - towards row 1 (bit index -8)
+ * right - towards the H file (bit index -1)
+ * A piece can make its k-th jump if it could make the (k-1)-th one, the
+ * square it hops over holds an enemy stone and the square it lands on is empty.
+ * Inlined where player is a constant, so the colour masks are too.
+ */
+static inline __attribute__((always_inline))
+void jumpSets(JumpSets *sets, BitBoard board, PlayerKind player) {
+  U64 own   = board.whole & PlayerSquares(player);
+  U64 opp   = board.whole & PlayerSquares(PlayerOpponent(player));
+  U64 empty = ~board.whole;
+
+  U64 up = own, left = own, down = own, right = own;
+#pragma GCC unroll 3
+  for (U8 k = 0; k < MAX_JUMPS; k++) {
+    U8 over = 2*k + 1, land = 2*k + 2;
+    up    &= (opp >> (8*over)) & (empty >> (8*land));
+    left  &= leftRoom[k] & (opp >> over) & (empty >> land);
+    down  &= (opp << (8*over)) & (empty << (8*land));
+    right &= rightRoom[k] & (opp << over) & (empty << land);
+
+    sets->jumps[Direction_up][k]    = up;
+    sets->jumps[Direction_left][k]  = left;
+    sets->jumps[Direction_down][k]  = down;
+    sets->jumps[Direction_right][k] = right;
+  }
+}
+
+
+void JumpSetsFromBoard(JumpSets *sets, BitBoard board, PlayerKind player) {
+  if (player == PlayerKind_White) jumpSets(sets, board, PlayerKind_White);
+  else jumpSets(sets, board, PlayerKind_Black);
+}
+
+
+U64 MovablePieces(BitBoard board, PlayerKind player) {
+  U64 own   = board.whole & PlayerSquares(player);
+  U64 opp   = board.whole & PlayerSquares(PlayerOpponent(player));
+  U64 empty = ~board.whole;
+
+  return own & (((opp >> 8) & (empty >> 16)) |
+                (leftRoom[0] & (opp >> 1) & (empty >> 2)) |
+                ((opp << 8) & (empty << 16)) |
+                (rightRoom[0] & (opp << 1) & (empty << 2)));
+}
+
+
+// Adds one bit to a counter kept as bit planes: counter[i] holds bit i of
+// the count for every square. Counts go no higher than 4 * MAX_JUMPS.
+static inline void bitCounterAdd(U64 counter[4], U64 bits) {
+  U64 carry = counter[0] & bits;
+  counter[0] ^= bits;
+  U64 carry2 = counter[1] & carry;
+  counter[1] ^= carry;
+  counter[3] |= counter[2] & carry2;
+  counter[2] ^= carry2;
+}
+
+static inline U32 bitCounterTotal(U64 counter[4]) {
+  return PopCount(counter[0]) + 2*PopCount(counter[1]) + 4*PopCount(counter[2]) + 8*PopCount(counter[3]);
+}
+
+
+/*
+ * Same sets as JumpSetsFromBoard() but for both colors in one pass, so the
+ * empty square shifts are shared. A piece that can make a k+1 stone jump
+ * can also make the k stone one, so the first round gives the movable
+ * sets and the terminal flag. Counting moves needs the longer jumps too,
+ * which costs about three times as much, so it is only done when asked
+ * for. The moves are added up per square in bit planes instead of a
+ * popcount per set and only counted at the end.
+ */
+void MobilityFromBoard(BitBoard board, PlayerKind toMove, Bool countMoves, Mobility *mobility) {
+  U64 white = board.whole & ALL_WHITE;
+  U64 black = board.whole & ALL_BLACK;
+  U64 empty = ~board.whole;
+
+  U64 wUp = white, wLeft = white, wDown = white, wRight = white;
+  U64 bUp = black, bLeft = black, bDown = black, bRight = black;
+  U64 whiteCount[4] = {0}, blackCount[4] = {0};
+
+  for (U8 k = 0; k < MAX_JUMPS; k++) {
+    U8 over = 2*k + 1, land = 2*k + 2;
+    U64 emptyUp = empty >> (8*land), emptyDown = empty << (8*land);
+    U64 emptyLeft = leftRoom[k] & (empty >> land), emptyRight = rightRoom[k] & (empty << land);
+
+    wUp    &= (black >> (8*over)) & emptyUp;
+    wLeft  &= (black >> over) & emptyLeft;
+    wDown  &= (black << (8*over)) & emptyDown;
+    wRight &= (black << over) & emptyRight;
+    bUp    &= (white >> (8*over)) & emptyUp;
+    bLeft  &= (white >> over) & emptyLeft;
+    bDown  &= (white << (8*over)) & emptyDown;
+    bRight &= (white << over) & emptyRight;
+
+    U64 whiteAny = wUp | wLeft | wDown | wRight;
+    U64 blackAny = bUp | bLeft | bDown | bRight;
+    if (k == 0) {
+      mobility->movable[PlayerKind_White] = whiteAny;
+      mobility->movable[PlayerKind_Black] = blackAny;
+      mobility->terminal = !mobility->movable[toMove];
+      mobility->toMove = toMove;
+      mobility->board = board.whole;
+      if (!countMoves) {
+        mobility->moves[PlayerKind_White] = mobility->moves[PlayerKind_Black] = 0;
+        return;
+      }
+    }
+    if (!(whiteAny | blackAny)) break;
+
+    bitCounterAdd(whiteCount, wUp);
+    bitCounterAdd(whiteCount, wLeft);
+    bitCounterAdd(whiteCount, wDown);
+    bitCounterAdd(whiteCount, wRight);
+    bitCounterAdd(blackCount, bUp);
+    bitCounterAdd(blackCount, bLeft);
+    bitCounterAdd(blackCount, bDown);
+    bitCounterAdd(blackCount, bRight);
+  }
+
+  mobility->moves[PlayerKind_White] = bitCounterTotal(whiteCount);
+  mobility->moves[PlayerKind_Black] = bitCounterTotal(blackCount);
+}
+
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MOBILITY_SIMD 1
+
+// One board per lane. Operators on it work lane by lane, with a scalar
+// used as the same value in every lane.
+typedef U64 U64x8 __attribute__((vector_size(MOBILITY_BATCH_LANES * sizeof(U64))));
+
+// Keeps the pieces in jumps that can make their k-th jump in direction
+// dir. Vectors go by pointer, passing them by value would depend on the
+// caller's instruction set.
+static inline __attribute__((always_inline))
+void lanesJump(U64x8 *jumps, const U64x8 *opp, const U64x8 *empty, U8 dir, U8 k) {
+  U8 over = 2*k + 1, land = 2*k + 2;
+  switch (dir) {
+    case Direction_up:   *jumps &= (*opp >> (8*over)) & (*empty >> (8*land)); break;
+    case Direction_left: *jumps &= leftRoom[k] & (*opp >> over) & (*empty >> land); break;
+    case Direction_down: *jumps &= (*opp << (8*over)) & (*empty << (8*land)); break;
+    default:             *jumps &= rightRoom[k] & (*opp << over) & (*empty << land); break;
+  }
+}
+
+/*
+ * MobilityFromBoard() on MOBILITY_BATCH_LANES boards at once, the same
+ * shifts and masks with a board in each lane. Written once and inlined
+ * into each wrapper below, which compiles it to two 4 lane AVX2
+ * instructions or one 8 lane AVX-512 one per step. AVX2 only has 16
+ * registers and each of these takes two, so unlike MobilityFromBoard()
+ * the work goes one side and one direction at a time to keep few sets
+ * live. Neither instruction set has a 64-bit popcount (without
+ * AVX512VPOPCNTDQ), the totals are counted lane by lane at the end.
+ */
+static inline __attribute__((always_inline))
+void mobilityLanes(const BitBoard *boards, const PlayerKind *toMove, Bool countMoves, Mobility *mobilities) {
+  U64x8 board;
+  for (U32 lane = 0; lane < MOBILITY_BATCH_LANES; lane++) board[lane] = boards[lane].whole;
+  U64x8 empty = ~board;
+  U64x8 pieces[2] = { board & ALL_WHITE, board & ALL_BLACK }; // by PlayerKind
+
+  U64x8 movable[2];
+  for (U32 side = 0; side < 2; side++) {
+    movable[side] = (U64x8){0};
+#pragma GCC unroll 4
+    for (U8 dir = 0; dir < 4; dir++) {
+      U64x8 jumps = pieces[side];
+      lanesJump(&jumps, &pieces[!side], &empty, dir, 0);
+      movable[side] |= jumps;
+    }
+  }
+
+  for (U32 lane = 0; lane < MOBILITY_BATCH_LANES; lane++) {
+    Mobility *mobility = &mobilities[lane];
+    mobility->movable[PlayerKind_White] = movable[PlayerKind_White][lane];
+    mobility->movable[PlayerKind_Black] = movable[PlayerKind_Black][lane];
+    mobility->moves[PlayerKind_White] = mobility->moves[PlayerKind_Black] = 0;
+    mobility->terminal = !mobility->movable[toMove[lane]];
+    mobility->toMove = toMove[lane];
+    mobility->board = boards[lane].whole;
+  }
+  if (!countMoves) return;
+
+  for (U32 side = 0; side < 2; side++) {
+    U64x8 counter[4] = {0};
+#pragma GCC unroll 4
+    for (U8 dir = 0; dir < 4; dir++) {
+      U64x8 jumps = pieces[side];
+#pragma GCC unroll 3
+      for (U8 k = 0; k < MAX_JUMPS; k++) {
+        lanesJump(&jumps, &pieces[!side], &empty, dir, k);
+        // bitCounterAdd()
+        U64x8 carry = counter[0] & jumps;
+        counter[0] ^= jumps;
+        U64x8 carry2 = counter[1] & carry;
+        counter[1] ^= carry;
+        counter[3] |= counter[2] & carry2;
+        counter[2] ^= carry2;
+      }
+    }
+    for (U32 lane = 0; lane < MOBILITY_BATCH_LANES; lane++) {
+      U64 planes[4] = { counter[0][lane], counter[1][lane], counter[2][lane], counter[3][lane] };
+      mobilities[lane].moves[side] = bitCounterTotal(planes);
+    }
+  }
+}
+
+__attribute__((target("avx2,popcnt")))
+static void mobilityLanesAvx2(const BitBoard *boards, const PlayerKind *toMove, Bool countMoves, Mobility *mobilities) {
+  mobilityLanes(boards, toMove, countMoves, mobilities);
+}
+
+__attribute__((target("avx512f,popcnt")))
+static void mobilityLanesAvx512(const BitBoard *boards, const PlayerKind *toMove, Bool countMoves, Mobility *mobilities) {
+  mobilityLanes(boards, toMove, countMoves, mobilities);
+}
+#endif
+
+
+static MobilityKernel mobilityKernel = MobilityKernel_Best;
+
+static MobilityKernel mobilityKernelSupported(MobilityKernel kernel) {
+#ifdef MOBILITY_SIMD
+  if (kernel >= MobilityKernel_Avx512 && __builtin_cpu_supports("avx512f")) return MobilityKernel_Avx512;
+  if (kernel >= MobilityKernel_Avx2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    return MobilityKernel_Avx2;
+  }
+#endif
+  return MobilityKernel_Scalar;
+}
+
+
+MobilityKernel MobilityKernelSelect(MobilityKernel kernel) {
+  kernel = mobilityKernelSupported(kernel);
+  __atomic_store_n(&mobilityKernel, kernel, __ATOMIC_RELAXED);
+  return kernel;
+}
+
+
+const char *MobilityKernelName(MobilityKernel kernel) {
+  const char *names[] = { "scalar", "avx2", "avx512" };
+  return (kernel < MobilityKernel_Best) ? names[kernel] : "best";
+}
+
+
+void MobilityFromBoards(const BitBoard *boards, const PlayerKind *toMove, U32 count, Bool countMoves, Mobility *mobilities) {
+  // Read by every thread and picked by whichever gets here first, every
+  // one picks the same kernel so relaxed is enough
+  MobilityKernel kernel = __atomic_load_n(&mobilityKernel, __ATOMIC_RELAXED);
+  if (kernel == MobilityKernel_Best) kernel = MobilityKernelSelect(MobilityKernel_Best);
+
+  U32 i = 0;
+#ifdef MOBILITY_SIMD
+  for (; kernel != MobilityKernel_Scalar && i + MOBILITY_BATCH_LANES <= count; i += MOBILITY_BATCH_LANES) {
+    if (kernel == MobilityKernel_Avx512) mobilityLanesAvx512(&boards[i], &toMove[i], countMoves, &mobilities[i]);
+    else mobilityLanesAvx2(&boards[i], &toMove[i], countMoves, &mobilities[i]);
+  }
+#endif
+  for (; i < count; i++) MobilityFromBoard(boards[i], toMove[i], countMoves, &mobilities[i]);
+}
+
+
+/*
+ * There is one of these for each colour, GenerateMovesWhite() and
+ * GenerateMovesBlack(), with player a constant: the colour masks are
+ * immediates instead of picked per call, and with the loops unrolled
+ * every direction and jump length has its step built in too.
+ */
+static inline __attribute__((always_inline))
+U32 generateMoves(BitBoard board, PlayerKind player, MoveList *list) {
+  JumpSets sets;
+  jumpSets(&sets, board, player);
+
+  U32 count = 0;
+#pragma GCC unroll 4
+  for (U8 dir = 0; dir < 4; dir++) {
+#pragma GCC unroll 3
+    for (U8 k = 0; k < MAX_JUMPS; k++) {
+      U64 pieces = sets.jumps[dir][k];
+      I8 delta = jumpStep[dir] * (k+1);
+      while (pieces) {
+        U8 from = __builtin_ctzll(pieces);
+        list->moves[count++] = MoveMake(from, from + delta);
+        pieces &= pieces - 1;
+      }
+    }
+  }
+
+  list->count = count;
+  return count;
+}
+
+U32 GenerateMovesWhite(BitBoard board, MoveList *list) {
+  return generateMoves(board, PlayerKind_White, list);
+}
+
+U32 GenerateMovesBlack(BitBoard board, MoveList *list) {
+  return generateMoves(board, PlayerKind_Black, list);
+}
+
+
+// Moves at the last ply are counted, not played
+U64 Perft(BitBoard board, PlayerKind player, U32 depth) {
+  if (depth == 0) return 1;
+
+  MoveList list;
+  U32 count = GenerateMoves(board, player, &list);
+  if (depth == 1) return count;
+
+  U64 nodes = 0;
+  for (U32 i = 0; i < count; i++) {
+    BitBoard child = { .whole = board.whole ^ MoveMask(list.moves[i]) };
+    nodes += Perft(child, PlayerOpponent(player), depth - 1);
+  }
+
+  return nodes;
+}
+
+
+void MoveToText(Move move, char *text) {
+  bitToTextCoord(1llu << MoveFrom(move), text);
+  text[2] = '-';
+  bitToTextCoord(1llu << MoveTo(move), text + 3);
+}
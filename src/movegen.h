@@ -0,0 +1,153 @@
+/*
+  USAGE:
+    The files movegen.h and movegen.c are for set-wise move generation.
+    Instead of scanning the board one empty square at a time we shift
+    the whole board in each direction and mask it, so every single and
+    multi jump for a side is found with a fixed number of 64-bit
+    operations. The jumps are then written into a flat MoveList.
+
+    MoveList list;
+    GenerateMoves(board, PlayerKind_White, &list);
+    for (U32 i = 0; i < list.count; i++) {
+      BitBoard child = board;
+      child.whole ^= MoveMask(list.moves[i]);
+    }
+
+    MobilityFromBoards() gives MobilityFromBoard() for a whole array of
+    boards, MOBILITY_BATCH_LANES at a time in AVX2 or AVX-512 registers
+    when the CPU has them.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+#include "types.h"
+
+#define ALL_BLACK     0xAA55AA55AA55AA55llu
+#define ALL_WHITE     0x55AA55AA55AA55AAllu
+#define FILE_H        0x0101010101010101llu // bit 0 of every row is the H file
+
+// Every landing square can be reached by at most one jump from each of the
+// four directions, and a side only lands on its own 32 squares.
+#define MAX_MOVES 128
+#define MAX_JUMPS 3 // the most stones one move can capture on an 8x8 board
+#define MAX_PLY 64 // every move captures a stone so no game gets this long
+
+// A move is the index of the piece that moves and the index it lands on.
+// from == to is never legal, so 0 can be used as "no move".
+typedef U16 Move;
+#define MOVE_NONE 0
+#define MoveMake(from, to) ((Move)((from) | ((to) << 6)))
+#define MoveFrom(move) ((U8)((move) & 0x3F))
+#define MoveTo(move)   ((U8)(((move) >> 6) & 0x3F))
+
+typedef struct MoveList MoveList;
+struct MoveList {
+  U32 count;
+  Move moves[MAX_MOVES];
+};
+
+// jumps[direction][k] holds every piece that can make a k+1 stone jump in
+// that direction (Direction_up, Direction_left, ...)
+typedef struct JumpSets JumpSets;
+struct JumpSets {
+  U64 jumps[4][MAX_JUMPS];
+};
+
+// __builtin_popcountll() is a libgcc call unless the build targets a cpu
+// with popcnt, and the mobility counts do a lot of them
+static inline U32 PopCount(U64 x) {
+#if defined(__POPCNT__)
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555llu);
+  x = (x & 0x3333333333333333llu) + ((x >> 2) & 0x3333333333333333llu);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Fllu;
+  return (x * 0x0101010101010101llu) >> 56;
+#endif
+}
+
+static inline U64 PlayerSquares(PlayerKind player) {
+  return (player == PlayerKind_White) ? ALL_WHITE : ALL_BLACK;
+}
+
+static inline PlayerKind PlayerOpponent(PlayerKind player) {
+  return (player == PlayerKind_White) ? PlayerKind_Black : PlayerKind_White;
+}
+
+// The bits to xor into BitBoard.whole to play (or take back) a move by
+// player: the moving piece, its landing square and every stone it
+// captures on the way, which are the other colour's.
+static inline U64 MoveMaskFor(Move move, PlayerKind player) {
+  U8 from = MoveFrom(move), to = MoveTo(move);
+  U8 lo = (from < to) ? from : to;
+  U8 hi = (from < to) ? to : from;
+  U64 line = (2llu << hi) - (1llu << lo); // wraps correctly when hi is 63
+  if (!((from ^ to) & 7)) line &= FILE_H << (from & 7);
+  return (line & PlayerSquares(PlayerOpponent(player))) | (1llu << from) | (1llu << to);
+}
+
+// MoveMaskFor() when who moves is not known, the square moved from says
+static inline U64 MoveMask(Move move) {
+  return MoveMaskFor(move, ((1llu << MoveFrom(move)) & ALL_WHITE) ? PlayerKind_White : PlayerKind_Black);
+}
+
+// The move that turns board into child. The stone lands on the only square
+// that was empty and leaves from the only square of the same colour that
+// empties, the stones it took are the other colour.
+static inline Move MoveFromBoards(U64 board, U64 child) {
+  U64 changed = board ^ child;
+  U64 to = changed & child;
+  U64 colour = (to & ALL_WHITE) ? ALL_WHITE : ALL_BLACK;
+  return MoveMake(__builtin_ctzll(changed & board & colour), __builtin_ctzll(to));
+}
+
+static inline U8 MoveJumpCount(Move move) {
+  U8 from = MoveFrom(move), to = MoveTo(move);
+  U8 dist = (from < to) ? to - from : from - to;
+  return (dist >= 8) ? dist / 16 : dist / 2;
+}
+
+// Everything the evaluation and the game over check need, for both sides
+// at once. Indexed by PlayerKind.
+typedef struct Mobility Mobility;
+struct Mobility {
+  U64 movable[2]; // pieces with at least one jump
+  U32 moves[2];   // legal moves, multi jumps included, 0 unless counted
+  Bool terminal;  // the side to move has no move and has lost
+  PlayerKind toMove;
+  U64 board;      // the one it was worked out for
+};
+
+#define MOBILITY_BATCH_LANES 8 // boards MobilityFromBoards() works out together
+
+// How MobilityFromBoards() does it, it picks the widest the CPU has unless told otherwise
+typedef U8 MobilityKernel;
+enum {
+  MobilityKernel_Scalar, // MobilityFromBoard() on each board
+  MobilityKernel_Avx2,   // 4 boards an instruction
+  MobilityKernel_Avx512, // 8 boards an instruction
+  MobilityKernel_Best,
+};
+
+void JumpSetsFromBoard(JumpSets *sets, BitBoard board, PlayerKind player);
+U64 MovablePieces(BitBoard board, PlayerKind player); // every piece with at least one jump
+void MobilityFromBoard(BitBoard board, PlayerKind toMove, Bool countMoves, Mobility *mobility);
+void MobilityFromBoards(const BitBoard *boards, const PlayerKind *toMove, U32 count, Bool countMoves, Mobility *mobilities);
+MobilityKernel MobilityKernelSelect(MobilityKernel kernel); // the CPU may not have it, returns the one it got
+const char *MobilityKernelName(MobilityKernel kernel);
+U32 GenerateMovesWhite(BitBoard board, MoveList *list); // returns list->count
+U32 GenerateMovesBlack(BitBoard board, MoveList *list);
+U64 Perft(BitBoard board, PlayerKind player, U32 depth); // leaf positions depth plies from board
+void MoveToText(Move move, char *text); // "F3-F5", text must hold MOVE_LENGTH chars
+
+// Each colour has its own generator with its masks built in. Where player
+// is a constant this is a direct call to it.
+static inline U32 GenerateMoves(BitBoard board, PlayerKind player, MoveList *list) {
+  return (player == PlayerKind_White) ? GenerateMovesWhite(board, list) : GenerateMovesBlack(board, list);
+}
+
+#endif
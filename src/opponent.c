@@ -0,0 +1,147 @@
+/*
+  USAGE:
+    opponent.c is a stand in for the course's konanerandomplayer, so games
+    can be played without the outside driver. It takes the same arguments
+    and speaks the same protocol as konane.exe: it moves first from the
+    board it is given, prints a removal as a square on its own line and a
+    jump after "Agent move: ", then reads the other side's move with
+    mainInput().
+
+    make harness
+    ./opponent.exe <boardfile> <B|W> [--player random|greedy|minimax] [--depth D] [--seed S]
+
+    random plays any legal move, greedy the move that leaves it the most
+    moves compared to the other side, and minimax searches depth plies
+    (default OPPONENT_DEFAULT_DEPTH) with the same count at the leaves.
+    Equal moves are picked between at random.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "boardio.h"
+#include "book.h"
+
+#define OPPONENT_DEFAULT_DEPTH 3
+#define OPPONENT_WIN 1000
+
+typedef U8 OpponentKind;
+enum {
+  OpponentKind_Random,
+  OpponentKind_Greedy,
+  OpponentKind_Minimax,
+};
+
+
+// Moves we have less the moves they have, for the side to move
+static I32 opponentMobility(BitBoard board, PlayerKind player) {
+  MoveList list;
+  I32 ours = GenerateMoves(board, player, &list);
+  if (!ours) return -OPPONENT_WIN;
+  return ours - (I32)GenerateMoves(board, PlayerOpponent(player), &list);
+}
+
+
+static I32 opponentNegamax(BitBoard board, PlayerKind player, I32 depth, I32 alpha, I32 beta) {
+  if (!depth) return opponentMobility(board, player);
+
+  MoveList list;
+  if (!GenerateMoves(board, player, &list)) return -OPPONENT_WIN - depth; // sooner is worse
+  for (U32 i = 0; i < list.count; i++) {
+    BitBoard child = { .whole = board.whole ^ MoveMask(list.moves[i]) };
+    I32 eval = -opponentNegamax(child, PlayerOpponent(player), depth - 1, -beta, -alpha);
+    if (eval > alpha) alpha = eval;
+    if (alpha >= beta) break;
+  }
+  return alpha;
+}
+
+
+static Move opponentChoose(OpponentKind kind, I32 depth, BitBoard board, PlayerKind player) {
+  MoveList list;
+  if (OpeningRemovals(board, player, &list)) return list.moves[rand() % list.count];
+  if (!GenerateMoves(board, player, &list)) return MOVE_NONE;
+  if (kind == OpponentKind_Random) return list.moves[rand() % list.count];
+
+  // Scores are for us, the ones a child returns are for them
+  I32 scores[MAX_MOVES];
+  I32 best = -OPPONENT_WIN * 2;
+  for (U32 i = 0; i < list.count; i++) {
+    BitBoard child = { .whole = board.whole ^ MoveMask(list.moves[i]) };
+    if (kind == OpponentKind_Greedy) scores[i] = -opponentMobility(child, PlayerOpponent(player));
+    else scores[i] = -opponentNegamax(child, PlayerOpponent(player), depth - 1, -OPPONENT_WIN * 2, OPPONENT_WIN * 2);
+    if (scores[i] > best) best = scores[i];
+  }
+
+  U32 ties = 0;
+  Move chosen = MOVE_NONE;
+  for (U32 i = 0; i < list.count; i++) {
+    if (scores[i] == best && !(rand() % ++ties)) chosen = list.moves[i];
+  }
+  return chosen;
+}
+
+
+int main(int argc, char **argv) {
+  OpponentKind kind = OpponentKind_Random;
+  I32 depth = OPPONENT_DEFAULT_DEPTH;
+  U32 seed = (U32)time(NULL);
+
+  Bool ok = argc >= 3 && (*argv[2] == 'B' || *argv[2] == 'W');
+  for (int i = 3; ok && i < argc; i++) {
+    if (!strcmp(argv[i], "--player") && i + 1 < argc) {
+      i++;
+      if (!strcmp(argv[i], "random")) kind = OpponentKind_Random;
+      else if (!strcmp(argv[i], "greedy")) kind = OpponentKind_Greedy;
+      else if (!strcmp(argv[i], "minimax")) kind = OpponentKind_Minimax;
+      else ok = Bool_False;
+    }
+    else if (!strcmp(argv[i], "--depth") && i + 1 < argc) depth = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = strtoul(argv[++i], NULL, 10);
+    else ok = Bool_False;
+  }
+  if (!ok) {
+    printf("usage: opponent.exe <boardfile> <B|W> [--player random|greedy|minimax] [--depth D] [--seed S]\n");
+    return -1;
+  }
+  if (depth < 1) depth = 1;
+  srand(seed);
+
+  Arena *arena = ArenaInit(Megabyte(1));
+  BitBoard board = BitBoardFromFile(arena, argv[1]);
+  PlayerKind player = (*argv[2] == 'W') ? PlayerKind_White : PlayerKind_Black;
+
+  // Like konane.exe we move first, then wait for the reply
+  while (!feof(stdin)) {
+    Move move = opponentChoose(kind, depth, board, player);
+    if (move == MOVE_NONE) {
+      printf("Agent move: \nLost\n");
+      break;
+    }
+
+    if (MoveIsRemoval(move)) {
+      char text[3];
+      bitToTextCoord(1llu << MoveFrom(move), text);
+      printf("%s\n", text);
+      board.whole ^= 1llu << MoveFrom(move);
+    } else {
+      char text[MOVE_LENGTH];
+      MoveToText(move, text);
+      printf("Agent move: %s\n", text);
+      board.whole ^= MoveMask(move);
+    }
+    fflush(stdout);
+
+    mainInput(&board, PlayerOpponent(player));
+  }
+
+  ArenaDeinit(arena);
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include <string.h>
+#include "ordering.h"
+#include "types.h"
+#include "movegen.h"
+
+#define HASH_MOVE_SCORE   (1 << 30)
+#define KILLER_SCORE      (1 << 24) // minus the slot, the newest killer goes first
+#define JUMP_BONUS        (1 << 12) // per stone captured beyond the first
+
+
+void MoveOrderingClear(MoveOrdering *ordering) {
+  memset(ordering, 0, sizeof(MoveOrdering));
+}
+
+
+void OrderMoves(MoveOrdering *ordering, MoveList *list, U32 ply, Move hashMove) {
+  U32 scores[MAX_MOVES];
+  Move *killers = ordering->killers[ply];
+
+  for (U32 i = 0; i < list->count; i++) {
+    Move move = list->moves[i];
+    U32 score;
+    if (move == hashMove) score = HASH_MOVE_SCORE;
+    else if (move == killers[0]) score = KILLER_SCORE;
+    else if (move == killers[1]) score = KILLER_SCORE - 1;
+    else score = ordering->history[MoveFrom(move)][MoveTo(move)] + (MoveJumpCount(move) - 1) * JUMP_BONUS;
+
+    // insertion sort, the lists are short
+    U32 j = i;
+    while (j > 0 && scores[j-1] < score) {
+      scores[j] = scores[j-1];
+      list->moves[j] = list->moves[j-1];
+      j--;
+    }
+    scores[j] = score;
+    list->moves[j] = move;
+  }
+}
+
+
+void MoveOrderingCutoff(MoveOrdering *ordering, Move move, U32 ply, I32 depth) {
+  Move *killers = ordering->killers[ply];
+  if (killers[0] != move) {
+    killers[1] = killers[0];
+    killers[0] = move;
+  }
+
+  // deep cutoffs say more about a move than ones near the leaves
+  U32 *entry = &ordering->history[MoveFrom(move)][MoveTo(move)];
+  *entry += depth * depth;
+  if (*entry >= HISTORY_MAX) {
+    for (U32 from = 0; from < 64; from++) {
+      for (U32 to = 0; to < 64; to++) {
+        ordering->history[from][to] >>= 1;
+      }
+    }
+  }
+}
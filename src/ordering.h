@@ -0,0 +1,45 @@
+/*
+  USAGE:
+    The files ordering.h and ordering.c are for move ordering in the
+    search. Alpha-beta only cuts well if the best move is tried first, so
+    before looping over a node's moves we score them and sort best first:
+
+    1. the hash move (from the transposition table or the last iteration's
+       principal variation)
+    2. the two killer moves of this ply, moves that caused a cutoff in a
+       sibling position
+    3. everything else by its history score, how often and how deep
+       the same from/to pair has caused a cutoff, plus a bonus for every
+       extra stone the jump captures
+
+    OrderMoves(&ctx->ordering, list, ply, hashMove);
+    ...
+    if (beta <= alpha) {
+      MoveOrderingCutoff(&ctx->ordering, list->moves[i], ply, depth);
+      break;
+    }
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef ORDERING_H
+#define ORDERING_H
+
+#include "types.h"
+#include "movegen.h"
+
+#define KILLER_SLOTS 2
+#define HISTORY_MAX (1 << 16) // history is halved when any entry gets here
+
+typedef struct MoveOrdering MoveOrdering;
+struct MoveOrdering {
+  Move killers[MAX_PLY][KILLER_SLOTS];
+  U32 history[64][64]; // [from][to], a square's colour tells us whose move it is
+};
+
+void MoveOrderingClear(MoveOrdering *ordering);
+void OrderMoves(MoveOrdering *ordering, MoveList *list, U32 ply, Move hashMove);
+void MoveOrderingCutoff(MoveOrdering *ordering, Move move, U32 ply, I32 depth);
+
+#endif
@@ -0,0 +1,92 @@
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tablebase.h"
+#include "types.h"
+#include "movegen.h"
+
+Tablebase tablebase;
+U64 tablebaseBinomials[64][TABLEBASE_MAX_STONES + 1];
+
+
+void TablebaseInit(void) {
+  for (U32 n = 0; n < 64; n++) {
+    tablebaseBinomials[n][0] = 1;
+    for (U32 k = 1; k <= TABLEBASE_MAX_STONES; k++) {
+      tablebaseBinomials[n][k] = (n) ? tablebaseBinomials[n-1][k-1] + tablebaseBinomials[n-1][k] : 0;
+    }
+  }
+}
+
+
+/*
+ * Maps the file and points the entries of each stone count into it. A
+ * file from another version, or one cut short, is refused rather than
+ * read wrong.
+ */
+Bool TablebaseLoad(const char *path) {
+  TablebaseInit();
+  TablebaseUnload();
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return Bool_False;
+  struct stat st;
+  if (fstat(fd, &st) || (U64)st.st_size < sizeof(TablebaseHeader)) {
+    close(fd);
+    return Bool_False;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps the file open
+  if (map == MAP_FAILED) return Bool_False;
+
+  const TablebaseHeader *header = map;
+  Bool valid = !memcmp(header->magic, TABLEBASE_MAGIC, sizeof(header->magic)) &&
+               header->version == TABLEBASE_VERSION &&
+               header->maxStones <= TABLEBASE_MAX_STONES &&
+               header->offsets[header->maxStones + 1] == (U64)st.st_size;
+  for (U32 k = 0; valid && k <= header->maxStones; k++) {
+    valid = header->offsets[k] >= sizeof(TablebaseHeader) &&
+            header->offsets[k + 1] - header->offsets[k] == TablebaseBoardCount(k);
+  }
+  if (!valid) {
+    munmap(map, st.st_size);
+    return Bool_False;
+  }
+
+  // Probes jump all over the file
+  madvise(map, st.st_size, MADV_RANDOM);
+
+  tablebase.map = map;
+  tablebase.size = st.st_size;
+  tablebase.maxStones = header->maxStones;
+  for (U32 k = 0; k <= header->maxStones; k++) tablebase.entries[k] = (const U8 *)map + header->offsets[k];
+  return Bool_True;
+}
+
+
+void TablebaseUnload(void) {
+  if (tablebase.map) munmap((void *)tablebase.map, tablebase.size);
+  memset(&tablebase, 0, sizeof(tablebase));
+}
+
+
+// 64 choose stones, the table stops at 63
+U64 TablebaseBoardCount(U32 stones) {
+  return tablebaseBinomials[63][stones] + ((stones) ? tablebaseBinomials[63][stones - 1] : 0);
+}
+
+
+// Takes the highest square that still fits each time, the inverse of TablebaseIndex()
+U64 TablebaseUnrank(U32 stones, U64 index) {
+  U64 board = 0;
+  for (U32 k = stones; k > 0; k--) {
+    U32 square = k - 1;
+    while (square + 1 < 64 && tablebaseBinomials[square + 1][k] <= index) square++;
+    index -= tablebaseBinomials[square][k];
+    board |= 1llu << square;
+  }
+  return board;
+}
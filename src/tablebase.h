@@ -0,0 +1,98 @@
+/*
+  USAGE:
+    The files tablebase.h and tablebase.c are for the endgame tablebase:
+    the win or loss, and how many plies until the game ends, of every
+    position with at most a few stones on the board, for both sides to
+    move. tablegen.c works it out offline from the emptiest boards up and
+    writes it to a file, the agent maps that file in at startup and looks
+    positions up instead of searching them.
+
+    Every position with k stones is a set of k squares, and the sets of k
+    squares are numbered in colexicographic order (the order their U64s
+    sort in), so a position's entry is found by counting without any
+    hashing or searching. Each entry is one byte, white to move in the low
+    nibble and black to move in the high one.
+
+    The file is the TablebaseHeader followed by the entries of each stone
+    count, in host byte order. Nothing has to be parsed, it is mapped read
+    only and shared by every search thread:
+
+    TablebaseLoad("konane.tb"); // once at startup, false if there is none
+    TablebaseResult result;
+    if (TablebaseProbe(board, PlayerKind_White, &result) && result.win) ...
+    TablebaseUnload();
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include "types.h"
+#include "movegen.h"
+
+#define TABLEBASE_MAGIC "KONANETB"
+#define TABLEBASE_VERSION 1 // bump whenever the layout or the entries change
+#define TABLEBASE_MAX_STONES 8 // a game with k stones lasts at most k - 1 plies, that has to fit in 3 bits
+#define TABLEBASE_DEFAULT_STONES 6 // about 80 megabytes
+#define TABLEBASE_DEFAULT_PATH "konane.tb"
+
+// An entry nibble: TABLEBASE_WIN if the side to move wins, and the plies
+// left until someone cannot move, the winner hurrying and the loser not
+#define TABLEBASE_WIN 0x8
+#define TABLEBASE_PLIES 0x7
+
+typedef struct TablebaseHeader TablebaseHeader;
+struct TablebaseHeader {
+  char magic[8];
+  U32 version;
+  U32 maxStones;
+  U64 offsets[TABLEBASE_MAX_STONES + 2]; // file offset of the entries with k stones, the last is the file size
+};
+
+typedef struct Tablebase Tablebase;
+struct Tablebase {
+  const U8 *map; // NULL when nothing is loaded
+  U64 size;
+  U32 maxStones;
+  const U8 *entries[TABLEBASE_MAX_STONES + 1]; // by stone count
+};
+
+typedef struct TablebaseResult TablebaseResult;
+struct TablebaseResult {
+  Bool win; // for the side to move
+  U8 plies; // until the game is over
+};
+
+extern Tablebase tablebase;
+extern U64 tablebaseBinomials[64][TABLEBASE_MAX_STONES + 1]; // tablebaseBinomials[n][k] is n choose k
+
+void TablebaseInit(void); // fills tablebaseBinomials, TablebaseLoad() calls it
+Bool TablebaseLoad(const char *path);
+void TablebaseUnload(void);
+U64 TablebaseBoardCount(U32 stones); // boards with that many stones, the entries they take up
+U64 TablebaseUnrank(U32 stones, U64 index); // the board with this index among boards with that many stones
+
+// The number of boards with as many stones as this one that come before it
+static inline U64 TablebaseIndex(U64 stones) {
+  U64 index = 0;
+  for (U32 i = 1; stones; i++, stones &= stones - 1) {
+    index += tablebaseBinomials[__builtin_ctzll(stones)][i];
+  }
+  return index;
+}
+
+static inline Bool TablebaseProbe(BitBoard board, PlayerKind player, TablebaseResult *result) {
+  if (!tablebase.map) return Bool_False;
+  U32 stones = PopCount(board.whole);
+  if (stones > tablebase.maxStones) return Bool_False;
+
+  U8 entry = tablebase.entries[stones][TablebaseIndex(board.whole)];
+  if (player == PlayerKind_Black) entry >>= 4;
+  result->win = (entry & TABLEBASE_WIN) ? Bool_True : Bool_False;
+  result->plies = entry & TABLEBASE_PLIES;
+  return Bool_True;
+}
+
+#endif
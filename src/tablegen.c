@@ -0,0 +1,176 @@
+/*
+  USAGE:
+    tablegen.c is the offline generator for the endgame tablebase (see
+    tablebase.h). Like meta.c it is its own program, run it once and the
+    agent picks the file up when it starts:
+
+    make tablebase
+    ./tablegen.exe [file] [max stones]
+
+    Every move takes at least one stone, so a position's children always
+    have fewer stones than it does. Solving every board with 0 stones, then
+    every board with 1 and so on means each child is already in the table
+    when its parent is looked at, and nothing has to be searched.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "tablebase.h"
+#include "threadpool.h"
+#include "timer.h"
+
+#define TABLEGEN_CHUNK 4096 // boards a thread takes at a time
+
+
+typedef struct TablegenJob TablegenJob;
+struct TablegenJob {
+  U8 *entries[TABLEBASE_MAX_STONES + 1]; // every stone count up to stones is done already
+  U32 stones;
+  U64 boardCount;
+  U64 next; // index of the next chunk nobody has taken, atomic
+  U64 whiteWins;
+  U64 blackWins;
+};
+
+
+static inline U32 min(U32 x, U32 y) {
+  return x < y ? x : y;
+}
+
+static inline U32 max(U32 x, U32 y) {
+  return x > y ? x : y;
+}
+
+
+// The entry nibble for player to move, from the entries of the children
+static U8 solveBoard(TablegenJob *job, U64 board, PlayerKind player) {
+  MoveList list;
+  BitBoard bitBoard = { .whole = board };
+  if (!GenerateMoves(bitBoard, player, &list)) return 0;
+
+  // A win takes the quickest child the opponent loses in, a loss holds out
+  // in the slowest child
+  U32 winPlies = TABLEBASE_PLIES + 1, lossPlies = 0;
+  U32 shift = (player == PlayerKind_White) ? 4 : 0; // the opponent's nibble
+  for (U32 i = 0; i < list.count; i++) {
+    U64 child = board ^ MoveMask(list.moves[i]);
+    U8 entry = job->entries[PopCount(child)][TablebaseIndex(child)] >> shift;
+    U32 plies = (entry & TABLEBASE_PLIES) + 1;
+    if (!(entry & TABLEBASE_WIN)) winPlies = min(winPlies, plies);
+    else lossPlies = max(lossPlies, plies);
+  }
+
+  if (winPlies <= TABLEBASE_PLIES) return TABLEBASE_WIN | winPlies;
+  return lossPlies;
+}
+
+
+/*
+ * Boards with the same number of stones never depend on each other, so
+ * the threads just take chunks of them in index order. Going to the next
+ * board with the same number of bits is the next index.
+ */
+static void tablegenWork(void *data, U32 threadIndex) {
+  TablegenJob *job = data;
+  (void)threadIndex; // chunks go to whichever thread asks first
+  U8 *entries = job->entries[job->stones];
+  U64 whiteWins = 0, blackWins = 0;
+
+  for (;;) {
+    U64 start = __atomic_fetch_add(&job->next, TABLEGEN_CHUNK, __ATOMIC_RELAXED);
+    if (start >= job->boardCount) break;
+    U64 end = (start + TABLEGEN_CHUNK < job->boardCount) ? start + TABLEGEN_CHUNK : job->boardCount;
+
+    U64 board = TablebaseUnrank(job->stones, start);
+    for (U64 index = start; index < end; index++) {
+      U8 white = solveBoard(job, board, PlayerKind_White);
+      U8 black = solveBoard(job, board, PlayerKind_Black);
+      entries[index] = white | (black << 4);
+      whiteWins += (white & TABLEBASE_WIN) != 0;
+      blackWins += (black & TABLEBASE_WIN) != 0;
+
+      // Gosper's hack, the next bigger number with as many bits set
+      if (!board) break;
+      U64 low = board & -board;
+      U64 ripple = board + low;
+      board = ripple | (((board ^ ripple) >> 2) / low);
+    }
+  }
+
+  __atomic_fetch_add(&job->whiteWins, whiteWins, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&job->blackWins, blackWins, __ATOMIC_RELAXED);
+}
+
+
+int main(int argc, char **argv) {
+  const char *path = (argc > 1) ? argv[1] : TABLEBASE_DEFAULT_PATH;
+  U32 maxStones = (argc > 2) ? strtoul(argv[2], NULL, 10) : TABLEBASE_DEFAULT_STONES;
+  if (argc > 3 || maxStones > TABLEBASE_MAX_STONES) {
+    printf("usage: tablegen.exe [file] [max stones, at most %d]\n", TABLEBASE_MAX_STONES);
+    return -1;
+  }
+
+  TablebaseInit();
+  TablebaseHeader header = {
+    .magic = TABLEBASE_MAGIC,
+    .version = TABLEBASE_VERSION,
+    .maxStones = maxStones,
+  };
+  U64 offset = sizeof(TablebaseHeader);
+  for (U32 k = 0; k <= maxStones; k++) {
+    header.offsets[k] = offset;
+    offset += TablebaseBoardCount(k);
+  }
+  header.offsets[maxStones + 1] = offset;
+
+  Arena *arena = ArenaInit(offset + Megabyte(1));
+  TablegenJob job = { 0 };
+  for (U32 k = 0; k <= maxStones; k++) job.entries[k] = ArenaPushNoZero(arena, TablebaseBoardCount(k));
+
+  U32 threadCount = ThreadCountOnline();
+  ThreadPool *pool = (threadCount > 1) ? ThreadPoolInit(arena, threadCount - 1) : NULL;
+
+  printf("stones        boards  white wins  black wins    seconds\n");
+  U64 totalStart = TimerNow();
+  for (U32 k = 0; k <= maxStones; k++) {
+    job.stones = k;
+    job.boardCount = TablebaseBoardCount(k);
+    job.next = 0;
+    job.whiteWins = job.blackWins = 0;
+
+    U64 start = TimerNow();
+    if (pool) ThreadPoolStart(pool, tablegenWork, &job);
+    tablegenWork(&job, 0);
+    if (pool) ThreadPoolWait(pool);
+
+    printf("%6u  %12llu  %9.2f%%  %9.2f%%  %9.3f\n", k, job.boardCount,
+           100.0 * job.whiteWins / job.boardCount, 100.0 * job.blackWins / job.boardCount,
+           TimerSeconds(TimerNow() - start));
+  }
+
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    printf("Could not open %s\n", path);
+    return -1;
+  }
+  Bool written = fwrite(&header, sizeof(header), 1, fp) == 1;
+  for (U32 k = 0; k <= maxStones && written; k++) {
+    written = fwrite(job.entries[k], 1, TablebaseBoardCount(k), fp) == TablebaseBoardCount(k);
+  }
+  written = !fclose(fp) && written;
+  if (!written) {
+    printf("Could not write %s\n", path);
+    return -1;
+  }
+  printf("\nWrote %llu bytes to %s in %.3f seconds\n", offset, path, TimerSeconds(TimerNow() - totalStart));
+
+  if (pool) ThreadPoolDeinit(pool);
+  ArenaDeinit(arena);
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include <unistd.h>
+#include "threadpool.h"
+#include "types.h"
+#include "allocators.h"
+
+typedef struct ThreadStart ThreadStart;
+struct ThreadStart {
+  ThreadPool *pool;
+  U32 index;
+};
+
+
+static void *ThreadPoolMain(void *arg) {
+  ThreadStart *start = arg;
+  ThreadPool *pool = start->pool;
+  U32 index = start->index;
+  U64 seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->quit && pool->generation == seen) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (pool->quit) break;
+
+    seen = pool->generation;
+    ThreadPoolJob job = pool->job;
+    void *data = pool->data;
+    pthread_mutex_unlock(&pool->lock);
+
+    job(data, index);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->running == 0) pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+
+ThreadPool *ThreadPoolInit(Arena *arena, U32 count) {
+  ThreadPool *pool = ArenaPush(arena, sizeof(ThreadPool));
+  ThreadStart *starts = ArenaPush(arena, count * sizeof(ThreadStart));
+  pool->threads = ArenaPush(arena, count * sizeof(pthread_t));
+  pool->count = count;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (U32 i = 0; i < count; i++) {
+    starts[i] = (ThreadStart){ .pool = pool, .index = i + 1 };
+    pthread_create(&pool->threads[i], NULL, ThreadPoolMain, &starts[i]);
+  }
+
+  return pool;
+}
+
+
+void ThreadPoolStart(ThreadPool *pool, ThreadPoolJob job, void *data) {
+  pthread_mutex_lock(&pool->lock);
+  pool->job = job;
+  pool->data = data;
+  pool->running = pool->count;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+void ThreadPoolWait(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->running) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+void ThreadPoolDeinit(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = Bool_True;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (U32 i = 0; i < pool->count; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->done);
+}
+
+
+U32 ThreadCountOnline(void) {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? (U32)count : 1;
+}
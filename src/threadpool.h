@@ -0,0 +1,50 @@
+/*
+  USAGE:
+    The files threadpool.h and threadpool.c are a small pthread pool. The
+    helper threads are started once and sleep until they are given a job,
+    so starting a parallel search every move costs a wake up, not a
+    pthread_create.
+
+    Every helper runs the same job, it tells them apart by the index it is
+    given (1 to count, index 0 is left for the thread that started it):
+
+    ThreadPool *pool = ThreadPoolInit(arena, 3);
+    ThreadPoolStart(pool, HelperSearch, agent);
+    HelperSearch(agent, 0); // the calling thread joins in
+    ThreadPoolWait(pool);
+    ThreadPoolDeinit(pool);
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+#include "types.h"
+#include "allocators.h"
+
+typedef void (*ThreadPoolJob)(void *data, U32 threadIndex);
+
+typedef struct ThreadPool ThreadPool;
+struct ThreadPool {
+  U32 count;
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t wake; // signalled when a job is posted
+  pthread_cond_t done; // signalled when the last helper finishes
+  U64 generation;      // bumped for every job so helpers never run one twice
+  U32 running;
+  Bool quit;
+  ThreadPoolJob job;
+  void *data;
+};
+
+ThreadPool *ThreadPoolInit(Arena *arena, U32 count); // count helper threads
+void ThreadPoolStart(ThreadPool *pool, ThreadPoolJob job, void *data);
+void ThreadPoolWait(ThreadPool *pool);
+void ThreadPoolDeinit(ThreadPool *pool);
+U32 ThreadCountOnline(void); // logical cores on this machine
+
+#endif
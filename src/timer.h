@@ -0,0 +1,35 @@
+/*
+  USAGE:
+    timer.h is a tiny header for measuring time with a monotonic clock.
+    Unlike time(NULL) it has sub-millisecond resolution and never jumps
+    when the wall clock is changed.
+
+    U64 start = TimerNow();
+    ...
+    double seconds = TimerSeconds(TimerNow() - start);
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <time.h>
+#include "types.h"
+
+#define NANOSECONDS_PER_SECOND      1000000000llu
+#define NANOSECONDS_PER_MILLISECOND 1000000llu
+
+// nanoseconds since some fixed point in the past
+static inline U64 TimerNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (U64)ts.tv_sec * NANOSECONDS_PER_SECOND + (U64)ts.tv_nsec;
+}
+
+static inline double TimerSeconds(U64 nanoseconds) {
+  return (double)nanoseconds / (double)NANOSECONDS_PER_SECOND;
+}
+
+#endif
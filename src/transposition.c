@@ -0,0 +1,148 @@
+#include <string.h>
+#include "transposition.h"
+#include "types.h"
+#include "allocators.h"
+
+// The seed is fixed so keys are the same every run, anything written to
+// disk with a key in it (books, tablebases) stays valid.
+#define ZOBRIST_SEED 0x4B6F6E616E65ull
+
+U64 zobristSquares[64];
+U64 zobristBlackToMove;
+
+
+// splitmix64, good enough for hash keys and tiny
+static U64 ZobristNext(U64 *state) {
+  U64 z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+
+void ZobristInit(void) {
+  U64 state = ZOBRIST_SEED;
+  for (U8 i = 0; i < 64; i++) {
+    zobristSquares[i] = ZobristNext(&state);
+  }
+  zobristBlackToMove = ZobristNext(&state);
+}
+
+
+U64 ZobristFromBits(U64 bits) {
+  U64 key = 0;
+  while (bits) {
+    key ^= zobristSquares[__builtin_ctzll(bits)];
+    bits &= bits - 1;
+  }
+  return key;
+}
+
+
+/*
+ * data layout
+ * bits  0-15 score
+ * bits 16-31 move
+ * bits 32-39 depth
+ * bits 40-41 bound
+ * bits 42-47 age
+ */
+static inline U64 TTPack(U8 depth, I16 score, BoundKind bound, Move move, U8 age) {
+  return (U64)(U16)score | ((U64)move << 16) | ((U64)depth << 32) |
+         ((U64)(bound & 0x3) << 40) | ((U64)(age & 0x3F) << 42);
+}
+
+static inline TTEntryData TTUnpack(U64 data) {
+  return (TTEntryData){
+    .score = (I16)(data & 0xFFFF),
+    .move  = (Move)((data >> 16) & 0xFFFF),
+    .depth = (U8)((data >> 32) & 0xFF),
+    .bound = (BoundKind)((data >> 40) & 0x3),
+    .age   = (U8)((data >> 42) & 0x3F),
+  };
+}
+
+
+TranspositionTable *TTInit(Arena *arena, U64 megabytes) {
+  TranspositionTable *tt = ArenaPush(arena, sizeof(TranspositionTable));
+
+  // round down to a power of two so the index is a mask
+  U64 bucketCount = 1;
+  while (bucketCount * 2 * sizeof(TTBucket) <= megabytes * Megabyte(1)) bucketCount *= 2;
+
+  // the arena only aligns offsets, so line the buckets up with the cache ourselves
+  char *buffer = ArenaPush(arena, bucketCount * sizeof(TTBucket) + sizeof(TTBucket));
+  tt->buckets = (TTBucket*)(((U64)buffer + sizeof(TTBucket) - 1) & ~(U64)(sizeof(TTBucket) - 1));
+
+  tt->mask = bucketCount - 1;
+  tt->age = 0;
+  return tt;
+}
+
+
+void TTClear(TranspositionTable *tt) {
+  memset(tt->buckets, 0, (tt->mask + 1) * sizeof(TTBucket));
+  tt->age = 0;
+}
+
+
+Bool TTProbe(TranspositionTable *tt, U64 key, TTEntryData *out) {
+  TTBucket *bucket = &tt->buckets[key & tt->mask];
+
+  for (U8 i = 0; i < TT_BUCKET_SIZE; i++) {
+    U64 data = __atomic_load_n(&bucket->entries[i].data, __ATOMIC_RELAXED);
+    U64 check = __atomic_load_n(&bucket->entries[i].check, __ATOMIC_RELAXED);
+    if ((check ^ data) == key && data) {
+      *out = TTUnpack(data);
+      return Bool_True;
+    }
+  }
+
+  return Bool_False;
+}
+
+
+/*
+ * Replacement: an entry for the same key is always overwritten unless it
+ * is exact, from this search and deeper. Otherwise we take the slot worth
+ * the least, where entries from older searches are worth nothing extra
+ * and entries from this search are worth their depth.
+ */
+void TTStore(TranspositionTable *tt, U64 key, U8 depth, I16 score, BoundKind bound, Move move) {
+  TTBucket *bucket = &tt->buckets[key & tt->mask];
+  TTEntry *victim = NULL;
+  I32 victimWorth = 0x7FFFFFFF;
+
+  for (U8 i = 0; i < TT_BUCKET_SIZE; i++) {
+    TTEntry *entry = &bucket->entries[i];
+    U64 data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+    U64 check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+
+    if (!data) {
+      victim = entry;
+      break;
+    }
+
+    TTEntryData old = TTUnpack(data);
+    if ((check ^ data) == key) {
+      if (old.age == tt->age && old.bound == BoundKind_Exact &&
+          bound != BoundKind_Exact && old.depth > depth) return;
+      // keep the old best move if we did not find one
+      if (move == MOVE_NONE) move = old.move;
+      victim = entry;
+      break;
+    }
+
+    I32 worth = old.depth + ((old.age == tt->age) ? 256 : 0);
+    if (worth < victimWorth) {
+      victimWorth = worth;
+      victim = entry;
+    }
+  }
+
+  // No lock: if another thread writes the same slot at the same time the
+  // check no longer matches either key and the entry reads as a miss
+  U64 data = TTPack(depth, score, bound, move, tt->age);
+  __atomic_store_n(&victim->data, data, __ATOMIC_RELAXED);
+  __atomic_store_n(&victim->check, key ^ data, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,86 @@
+/*
+  USAGE:
+    The files transposition.h and transposition.c are for the Zobrist keys
+    and the transposition table used by the search.
+
+    A board's key is the xor of a random number for every occupied square,
+    plus one more if black is to move. Playing a move only has to xor in
+    the keys of the squares in its MoveMask.
+
+    The table is an array of 64 byte buckets (one cache line) holding
+    TT_BUCKET_SIZE entries. Each entry is stored as (key ^ data, data) so a
+    torn write from another thread just looks like a miss.
+
+    ZobristInit(); // once at startup
+    TranspositionTable *tt = TTInit(arena, 64); // 64 megabytes
+    TTEntryData hit;
+    if (TTProbe(tt, key, &hit) && hit.depth >= depth) ...
+    TTStore(tt, key, depth, score, BoundKind_Exact, bestMove);
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+
+#define TT_BUCKET_SIZE 4 // 16 byte entries, 4 to a cache line
+#define TT_DEFAULT_MEGABYTES 64
+
+typedef U8 BoundKind;
+enum {
+  BoundKind_None,
+  BoundKind_Upper, // the real score is at most score
+  BoundKind_Lower, // the real score is at least score
+  BoundKind_Exact,
+};
+
+typedef struct TTEntry TTEntry;
+struct TTEntry {
+  U64 check; // key ^ data
+  U64 data;  // packed TTEntryData
+};
+
+typedef struct TTBucket TTBucket;
+struct TTBucket {
+  TTEntry entries[TT_BUCKET_SIZE];
+} __attribute__((aligned(64)));
+
+typedef struct TTEntryData TTEntryData;
+struct TTEntryData {
+  I16 score;
+  Move move;
+  U8 depth;
+  BoundKind bound;
+  U8 age;
+};
+
+typedef struct TranspositionTable TranspositionTable;
+struct TranspositionTable {
+  TTBucket *buckets;
+  U64 mask; // bucket count - 1, the count is a power of two
+  U8 age;   // bumped every search so old entries are replaced first
+};
+
+extern U64 zobristSquares[64];
+extern U64 zobristBlackToMove;
+
+void ZobristInit(void);
+U64 ZobristFromBits(U64 bits); // xor of the square keys of every set bit
+static inline U64 ZobristFromBoard(BitBoard board, PlayerKind toMove) {
+  return ZobristFromBits(board.whole) ^ ((toMove == PlayerKind_Black) ? zobristBlackToMove : 0);
+}
+
+TranspositionTable *TTInit(Arena *arena, U64 megabytes); // the table lives as long as the arena
+void TTClear(TranspositionTable *tt);
+static inline void TTNewSearch(TranspositionTable *tt) {
+  tt->age = (tt->age + 1) & 0x3F;
+}
+Bool TTProbe(TranspositionTable *tt, U64 key, TTEntryData *out);
+void TTStore(TranspositionTable *tt, U64 key, U8 depth, I16 score, BoundKind bound, Move move);
+
+#endif
@@ -0,0 +1,111 @@
+#include <string.h>
+#include "tree.h"
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+
+
+TreePool *TreePoolInit(Arena *arena, U64 megabytes) {
+  TreePool *pool = ArenaPush(arena, sizeof(TreePool));
+  U64 capacity = Megabyte(megabytes) / sizeof(TreeNode);
+  pool->capacity = (capacity > 0xFFFFFFFFllu) ? 0xFFFFFFFF : (U32)capacity;
+  pool->nodes = ArenaPushNoZero(arena, (U64)pool->capacity * sizeof(TreeNode));
+  pool->count = 1; // index 0 is TREE_NONE
+  return pool;
+}
+
+
+// length nodes next to each other, zeroed, TREE_NONE if there is no room
+static TreeIndex treeBlockAlloc(TreePool *pool, U32 length) {
+  TreeIndex index = pool->freeBlocks[length];
+  if (index) {
+    pool->freeBlocks[length] = pool->nodes[index].firstChild;
+    pool->stats.freeListHits++;
+  } else {
+    if (length > pool->capacity - pool->count) return TREE_NONE;
+    index = pool->count;
+    pool->count += length;
+    pool->stats.chunks++;
+  }
+
+  memset(&pool->nodes[index], 0, length * sizeof(TreeNode));
+  pool->used += length;
+  pool->stats.allocs++;
+  pool->stats.bytes = (U64)pool->used * sizeof(TreeNode);
+  if (pool->stats.bytes > pool->stats.peakBytes) pool->stats.peakBytes = pool->stats.bytes;
+  return index;
+}
+
+static void treeBlockFree(TreePool *pool, TreeIndex index, U32 length) {
+  pool->nodes[index].firstChild = pool->freeBlocks[length];
+  pool->freeBlocks[length] = index;
+  pool->used -= length;
+  pool->stats.frees++;
+  pool->stats.bytes = (U64)pool->used * sizeof(TreeNode);
+}
+
+
+TreeIndex TreeNodeAlloc(TreePool *pool, BitBoard board) {
+  TreeIndex index = treeBlockAlloc(pool, 1);
+  if (index) pool->nodes[index].board = board.whole;
+  return index;
+}
+
+
+Bool TreeNodeExpand(TreePool *pool, TreeIndex index, PlayerKind player) {
+  TreeNode *node = &pool->nodes[index];
+  if (node->flags & TreeFlag_Expanded) return Bool_True;
+
+  MoveList list;
+  BitBoard board = { .whole = node->board };
+  GenerateMoves(board, player, &list);
+
+  TreeIndex first = TREE_NONE;
+  if (list.count) {
+    first = treeBlockAlloc(pool, list.count);
+    if (!first) return Bool_False;
+  }
+  for (U32 i = 0; i < list.count; i++) {
+    pool->nodes[first + i].board = node->board ^ MoveMask(list.moves[i]);
+  }
+
+  node->firstChild = first;
+  node->childCount = list.count;
+  node->flags |= TreeFlag_Expanded;
+  return Bool_True;
+}
+
+
+void TreeFreeChildren(TreePool *pool, TreeIndex index) {
+  TreeNode *node = &pool->nodes[index];
+  for (U32 i = 0; i < node->childCount; i++) TreeFreeChildren(pool, node->firstChild + i);
+  if (node->childCount) treeBlockFree(pool, node->firstChild, node->childCount);
+
+  node->firstChild = TREE_NONE;
+  node->childCount = 0;
+  node->flags &= ~TreeFlag_Expanded;
+}
+
+
+void TreeFree(TreePool *pool, TreeIndex index) {
+  TreeFreeChildren(pool, index);
+  treeBlockFree(pool, index, 1);
+}
+
+
+/*
+ * A child shares its block with its brothers, so it can not stay where it
+ * is once they are freed. It is copied into a node of its own, which
+ * brings its subtree with it since nothing points back up.
+ */
+TreeIndex TreeKeepChild(TreePool *pool, TreeIndex index, U32 child) {
+  TreeNode *kept = &pool->nodes[pool->nodes[index].firstChild + child];
+  TreeNode copy = *kept;
+  kept->firstChild = TREE_NONE;
+  kept->childCount = 0;
+  TreeFree(pool, index);
+
+  TreeIndex root = treeBlockAlloc(pool, 1); // never fails, index was just freed
+  pool->nodes[root] = copy;
+  return root;
+}
@@ -0,0 +1,82 @@
+/*
+  USAGE:
+    The files tree.h and tree.c are the node pool for searches that keep
+    their whole tree in memory. A TreeNode is 16 bytes, four to a cache
+    line: the board, where its children start, how many there are and a
+    score. Nodes point at each other with 32-bit indices into one array
+    and the children of a node are next to each other, so going through
+    them walks an array instead of following next pointers.
+
+    TreePool *pool = TreePoolInit(arena, TREE_DEFAULT_MEGABYTES);
+    TreeIndex root = TreeNodeAlloc(pool, board);
+    if (TreeNodeExpand(pool, root, player)) { // false once the pool is full
+      TreeNode *node = TreeNodeGet(pool, root);
+      for (U32 i = 0; i < node->childCount; i++) {
+        TreeNode *child = TreeNodeGet(pool, node->firstChild + i);
+      }
+    }
+    root = TreeKeepChild(pool, root, 0); // the child's subtree is all that is left
+    TreeFree(pool, root);
+
+    The array never moves, so a TreeNode pointer stays good until its
+    node is freed. Index 0 is never handed out, TREE_NONE means no node.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef TREE_H
+#define TREE_H
+
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+
+#define TREE_DEFAULT_MEGABYTES 2048
+#define TREE_NONE 0
+
+typedef U32 TreeIndex;
+
+typedef U8 TreeFlags;
+enum {
+  TreeFlag_Expanded = 1 << 0, // children generated, childCount may be 0
+};
+
+typedef struct TreeNode TreeNode;
+struct TreeNode {
+  U64 board;
+  TreeIndex firstChild; // children are firstChild up to firstChild + childCount - 1
+  U8 childCount; // MAX_MOVES fits
+  TreeFlags flags;
+  I16 score; // for the player to move, what the last search found
+};
+
+_Static_assert(sizeof(TreeNode) == 16, "four TreeNodes have to fit in a cache line");
+
+typedef struct TreePool TreePool;
+struct TreePool {
+  TreeNode *nodes;
+  U32 capacity;
+  U32 count; // handed out from the end of the array so far, index 0 included
+  U32 used;  // in use right now
+  TreeIndex freeBlocks[MAX_MOVES + 1]; // freed runs of children by length, linked through firstChild
+  AllocStats stats; // counts blocks, a chunk is a block taken from the end of the array
+};
+
+TreePool *TreePoolInit(Arena *arena, U64 megabytes);
+TreeIndex TreeNodeAlloc(TreePool *pool, BitBoard board); // a node on its own, TREE_NONE if the pool is full
+Bool TreeNodeExpand(TreePool *pool, TreeIndex index, PlayerKind player); // false if the pool is full
+void TreeFree(TreePool *pool, TreeIndex index); // a node from TreeNodeAlloc() and everything under it
+void TreeFreeChildren(TreePool *pool, TreeIndex index); // leaves the node unexpanded
+TreeIndex TreeKeepChild(TreePool *pool, TreeIndex index, U32 child); // frees the rest of index's tree
+
+static inline TreeNode *TreeNodeGet(TreePool *pool, TreeIndex index) {
+  return &pool->nodes[index];
+}
+
+// The move between a node and one of its children
+static inline Move TreeNodeMove(const TreeNode *parent, const TreeNode *child) {
+  return MoveFromBoards(parent->board, child->board);
+}
+
+#endif
@@ -0,0 +1,359 @@
+/*
+  USAGE:
+    tune.c fits the evaluation's weights (see eval.h) to positions from
+    games whose winner is known, match.exe --record makes them. Like
+    bookgen.c it is its own program:
+
+    make tune
+    ./match.exe ab ab --games 40000 --depth 4 --endgame 0 --plies 8 --record positions.bin
+    ./tune.exe positions.bin [--epochs N] [--rate R] [--threads T] [--out FILE]
+
+    The chance white wins a position is taken to be a logistic curve of
+    its evaluation, 1 / (1 + e^(-K * eval)), and the weights are moved
+    down the gradient of the log loss against who really won (Adam, one
+    step per epoch over every position). K is fitted first, with the
+    weights the engine has now, so the new weights come out in the same
+    units as the old ones.
+
+    Every position's features are worked out once when the file is
+    loaded, on every thread, into EVAL_FEATURE_STRIDE bytes. The features
+    are small counts, so millions of positions only have a few thousand
+    different sets of them: positions with the same set are kept as one
+    row with how many games they were in and how many white won. The loss
+    and gradient come out exactly as if every position were there, and
+    an epoch is a pass over the rows split between the threads.
+
+    The weights are written to src/weights.h rounded to whole units, then
+    rebuild and check them with match.exe against the old build.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "allocators.h"
+#include "movegen.h"
+#include "threadpool.h"
+#include "eval.h"
+#include "timer.h"
+
+#define TUNE_DEFAULT_EPOCHS 1000
+#define TUNE_DEFAULT_RATE 0.05 // Adam step size, in weight units
+#define TUNE_DEFAULT_OUT "src/weights.h"
+#define TUNE_REPORT_EPOCHS 100
+#define TUNE_K_STEPS 40 // golden section steps fitting K
+#define TUNE_BATCH 256 // positions given to MobilityFromBoards() at once
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define ADAM_EPSILON 1e-8
+
+typedef U8 TuneJob;
+enum {
+  TuneJob_Features,
+  TuneJob_Gradient,
+};
+
+// Every position with these features
+typedef struct TuneRow TuneRow;
+struct TuneRow {
+  I8 features[EVAL_FEATURE_STRIDE];
+  U32 games; // 0 for an empty slot while the rows are hashed
+  U32 whiteWins;
+};
+
+// What one thread adds up over its share, on a cache line of its own
+typedef struct TunePartial TunePartial;
+struct TunePartial {
+  double gradient[EVAL_FEATURE_STRIDE];
+  double loss;
+} __attribute__((aligned(64)));
+
+typedef struct Tuner Tuner;
+struct Tuner {
+  const PositionEntry *positions;
+  U64 count;
+  U32 threads;
+  TuneJob job;
+
+  U64 *features; // EVAL_FEATURE_STRIDE bytes per position, read as one key
+  U8 *whiteWon;
+  TuneRow *rows;
+  U64 rowCount;
+  Bool wantLoss;
+
+  double k;
+  double weights[EvalFeature_Count];
+  TunePartial *partials;
+};
+
+static const char *featureNames[EvalFeature_Count] = {
+  "MOBILITY",
+  "CORNERS",
+  "EDGES",
+  "PARITY",
+  "REGIONS",
+};
+
+
+static void tuneFeatures(Tuner *tuner, U64 begin, U64 end) {
+  BitBoard boards[TUNE_BATCH];
+  PlayerKind toMove[TUNE_BATCH];
+  Mobility mobilities[TUNE_BATCH];
+
+  for (U64 batch = begin; batch < end; batch += TUNE_BATCH) {
+    U32 count = (end - batch < TUNE_BATCH) ? end - batch : TUNE_BATCH;
+    for (U32 i = 0; i < count; i++) {
+      boards[i].whole = tuner->positions[batch + i].board;
+      toMove[i] = tuner->positions[batch + i].player;
+    }
+    MobilityFromBoards(boards, toMove, count, Bool_False, mobilities);
+
+    for (U32 i = 0; i < count; i++) {
+      EvalFeatures(&mobilities[i], (I8 *)&tuner->features[batch + i]);
+      tuner->whiteWon[batch + i] = tuner->positions[batch + i].winner == PlayerKind_White;
+    }
+  }
+}
+
+
+static inline U64 hashMix(U64 x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+
+// Adds positions with the same features up into rows, they end up at the
+// start of the table. The table needs room for twice the positions.
+static void tuneRows(Tuner *tuner, TuneRow *table, U64 tableSize) {
+  for (U64 i = 0; i < tuner->count; i++) {
+    U64 key = tuner->features[i];
+    U64 slot = hashMix(key) & (tableSize - 1);
+    while (table[slot].games && memcmp(table[slot].features, &key, sizeof(key))) slot = (slot + 1) & (tableSize - 1);
+    memcpy(table[slot].features, &key, sizeof(key));
+    table[slot].games++;
+    table[slot].whiteWins += tuner->whiteWon[i];
+  }
+
+  U64 count = 0;
+  for (U64 slot = 0; slot < tableSize; slot++) {
+    if (table[slot].games) table[count++] = table[slot];
+  }
+  tuner->rows = table;
+  tuner->rowCount = count;
+}
+
+
+/*
+ * The log loss and its gradient by K * weight over rows begin to end,
+ * a row counts as many times as it has games. The loss takes a log as
+ * well as the exp, it is only worked out when wantLoss is set.
+ */
+static void tuneGradient(Tuner *tuner, U64 begin, U64 end, TunePartial *partial) {
+  double scaled[EVAL_FEATURE_STRIDE] = {0};
+  for (U32 f = 0; f < EvalFeature_Count; f++) scaled[f] = tuner->k * tuner->weights[f];
+  memset(partial, 0, sizeof(*partial));
+
+  for (U64 i = begin; i < end; i++) {
+    const TuneRow *row = &tuner->rows[i];
+    double z = 0;
+    for (U32 f = 0; f < EVAL_FEATURE_STRIDE; f++) z += scaled[f] * row->features[f];
+
+    // Both from e^-|z| so neither can overflow
+    double t = exp(-fabs(z));
+    double p = (z >= 0) ? 1.0 / (1.0 + t) : t / (1.0 + t);
+    double error = row->games * p - row->whiteWins;
+    for (U32 f = 0; f < EVAL_FEATURE_STRIDE; f++) partial->gradient[f] += error * row->features[f];
+    if (tuner->wantLoss) partial->loss += row->games * (log1p(t) + fmax(z, 0.0)) - row->whiteWins * z;
+  }
+}
+
+
+static void tuneJob(void *data, U32 threadIndex) {
+  Tuner *tuner = data;
+  U64 count = (tuner->job == TuneJob_Features) ? tuner->count : tuner->rowCount;
+  U64 begin = count * threadIndex / tuner->threads;
+  U64 end = count * (threadIndex + 1) / tuner->threads;
+  if (tuner->job == TuneJob_Features) tuneFeatures(tuner, begin, end);
+  else tuneGradient(tuner, begin, end, &tuner->partials[threadIndex]);
+}
+
+
+static void tuneRun(Tuner *tuner, ThreadPool *pool, TuneJob job) {
+  tuner->job = job;
+  if (pool) ThreadPoolStart(pool, tuneJob, tuner);
+  tuneJob(tuner, 0);
+  if (pool) ThreadPoolWait(pool);
+}
+
+
+// Mean log loss (0 unless wantLoss), the mean gradient by each weight goes in gradient
+static double tuneLoss(Tuner *tuner, ThreadPool *pool, Bool wantLoss, double *gradient) {
+  tuner->wantLoss = wantLoss;
+  tuneRun(tuner, pool, TuneJob_Gradient);
+
+  double loss = 0;
+  for (U32 f = 0; f < EvalFeature_Count; f++) gradient[f] = 0;
+  for (U32 t = 0; t < tuner->threads; t++) {
+    loss += tuner->partials[t].loss;
+    for (U32 f = 0; f < EvalFeature_Count; f++) gradient[f] += tuner->partials[t].gradient[f];
+  }
+  for (U32 f = 0; f < EvalFeature_Count; f++) gradient[f] *= tuner->k / tuner->count;
+  return loss / tuner->count;
+}
+
+
+// Golden section search for the K that fits the weights as they are best
+static void tuneFitK(Tuner *tuner, ThreadPool *pool) {
+  double gradient[EvalFeature_Count];
+  double phi = (sqrt(5.0) - 1.0) / 2.0;
+  double lo = 0.0, hi = 2.0;
+  for (U32 step = 0; step < TUNE_K_STEPS; step++) {
+    double a = hi - phi * (hi - lo), b = lo + phi * (hi - lo);
+    tuner->k = a;
+    double lossA = tuneLoss(tuner, pool, Bool_True, gradient);
+    tuner->k = b;
+    double lossB = tuneLoss(tuner, pool, Bool_True, gradient);
+    if (lossA < lossB) hi = b;
+    else lo = a;
+  }
+  tuner->k = (lo + hi) / 2.0;
+}
+
+
+static Bool tuneWriteWeights(Tuner *tuner, const char *path) {
+  FILE *fp = fopen(path, "w");
+  if (!fp) return Bool_False;
+  fprintf(fp, "/*\n"
+              "  USAGE:\n"
+              "    Written by tune.exe, the weight of each evaluation feature in eval.h\n"
+              "    in 1/EVAL_SCALE of a movable piece. Edit by hand or run make tune.\n"
+              "\n"
+              "  COPYRIGHT:\n"
+              "    Copyright 2024 Isaac McCracken - All rights reserved\n"
+              "*/\n"
+              "\n"
+              "#ifndef WEIGHTS_H\n"
+              "#define WEIGHTS_H\n"
+              "\n");
+  for (U32 f = 0; f < EvalFeature_Count; f++) {
+    fprintf(fp, "#define EVAL_WEIGHT_%s %ld\n", featureNames[f], lround(tuner->weights[f]));
+  }
+  fprintf(fp, "\n#endif\n");
+  return fclose(fp) == 0;
+}
+
+
+int main(int argc, char **argv) {
+  U32 epochs = TUNE_DEFAULT_EPOCHS;
+  double rate = TUNE_DEFAULT_RATE;
+  U32 threads = ThreadCountOnline();
+  const char *out = TUNE_DEFAULT_OUT;
+
+  Bool ok = argc >= 2;
+  for (int i = 2; ok && i < argc; i++) {
+    if (!strcmp(argv[i], "--epochs") && i + 1 < argc) epochs = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+    else ok = Bool_False;
+  }
+  if (!ok) {
+    printf("usage: tune.exe <positions> [--epochs N] [--rate R] [--threads T] [--out FILE]\n");
+    return -1;
+  }
+  if (!threads) threads = 1;
+
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) || (U64)st.st_size < sizeof(PositionsHeader)) {
+    printf("Could not read %s\n", argv[1]);
+    return -1;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  const PositionsHeader *header = map;
+  if (map == MAP_FAILED || memcmp(header->magic, POSITIONS_MAGIC, sizeof(header->magic)) ||
+      header->version != POSITIONS_VERSION ||
+      sizeof(PositionsHeader) + header->count * sizeof(PositionEntry) != (U64)st.st_size || !header->count) {
+    printf("%s is not a positions file from match.exe --record\n", argv[1]);
+    return -1;
+  }
+
+  Tuner tuner = {
+    .positions = (const PositionEntry *)(header + 1),
+    .count = header->count,
+    .threads = threads,
+    .weights = {
+      EVAL_WEIGHT_MOBILITY,
+      EVAL_WEIGHT_CORNERS,
+      EVAL_WEIGHT_EDGES,
+      EVAL_WEIGHT_PARITY,
+      EVAL_WEIGHT_REGIONS,
+    },
+  };
+  U64 tableSize = 1;
+  while (tableSize < 2 * tuner.count) tableSize *= 2;
+  Arena *arena = ArenaInit(tuner.count * (sizeof(U64) + sizeof(U8)) + tableSize * sizeof(TuneRow) + Megabyte(1));
+  tuner.features = ArenaPush(arena, tuner.count * sizeof(U64));
+  tuner.whiteWon = ArenaPush(arena, tuner.count * sizeof(U8));
+  TuneRow *table = ArenaPush(arena, tableSize * sizeof(TuneRow));
+  tuner.partials = ArenaPush(arena, (threads + 1) * sizeof(TunePartial));
+  tuner.partials = (TunePartial *)(((U64)tuner.partials + 63) & ~63llu);
+  ThreadPool *pool = (threads > 1) ? ThreadPoolInit(arena, threads - 1) : NULL;
+
+  U64 start = TimerNow();
+  tuneRun(&tuner, pool, TuneJob_Features);
+  munmap(map, st.st_size);
+  tuneRows(&tuner, table, tableSize);
+  printf("%llu positions, %llu different features, loaded in %.2f s on %u threads (%s)\n", tuner.count, tuner.rowCount,
+         TimerSeconds(TimerNow() - start), threads, MobilityKernelName(MobilityKernelSelect(MobilityKernel_Best)));
+
+  start = TimerNow();
+  tuneFitK(&tuner, pool);
+  double gradient[EvalFeature_Count];
+  double loss = tuneLoss(&tuner, pool, Bool_True, gradient);
+  printf("K %.5f, loss %.6f with the weights now\n", tuner.k, loss);
+
+  double moment[EvalFeature_Count] = {0}, velocity[EvalFeature_Count] = {0};
+  double beta1Power = 1.0, beta2Power = 1.0;
+  for (U32 epoch = 1; epoch <= epochs; epoch++) {
+    Bool report = !(epoch % TUNE_REPORT_EPOCHS) || epoch == epochs;
+    loss = tuneLoss(&tuner, pool, report, gradient);
+    beta1Power *= ADAM_BETA1;
+    beta2Power *= ADAM_BETA2;
+    for (U32 f = 0; f < EvalFeature_Count; f++) {
+      moment[f] = ADAM_BETA1 * moment[f] + (1.0 - ADAM_BETA1) * gradient[f];
+      velocity[f] = ADAM_BETA2 * velocity[f] + (1.0 - ADAM_BETA2) * gradient[f] * gradient[f];
+      double corrected = moment[f] / (1.0 - beta1Power);
+      tuner.weights[f] -= rate * corrected / (sqrt(velocity[f] / (1.0 - beta2Power)) + ADAM_EPSILON);
+    }
+
+    if (report) {
+      printf("epoch %5u  loss %.6f ", epoch, loss);
+      for (U32 f = 0; f < EvalFeature_Count; f++) printf(" %s %.2f", featureNames[f], tuner.weights[f]);
+      printf("\n");
+    }
+  }
+  double seconds = TimerSeconds(TimerNow() - start);
+  printf("%u epochs in %.2f s, %.0f million positions a second\n", epochs, seconds,
+         (epochs + 2.0 * TUNE_K_STEPS + 1) * tuner.count / seconds / 1e6);
+
+  if (!tuneWriteWeights(&tuner, out)) {
+    printf("Could not write %s\n", out);
+    return -1;
+  }
+  printf("Weights written to %s, rebuild to use them\n", out);
+
+  if (pool) ThreadPoolDeinit(pool);
+  ArenaDeinit(arena);
+  return 0;
+}
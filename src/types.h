@@ -48,7 +48,8 @@ union BitBoard {
 
 
 
-// 64 byte per node maybe we can cut down on size
+// 40 bytes per node, only perft's reference generator still builds these.
+// Searches that keep a tree use the 16 byte TreeNode in tree.h.
 typedef struct StateNode StateNode;
 struct StateNode {
   BitBoard   board;
@@ -57,7 +58,7 @@ struct StateNode {
   StateNode *firstChild;
   StateNode *lastChild;
   // U64 childCount;
-  I8 score;
+  I16 score;
   char move[MOVE_LENGTH];
 };
 
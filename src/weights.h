@@ -0,0 +1,19 @@
+/*
+  USAGE:
+    Written by tune.exe, the weight of each evaluation feature in eval.h
+    in 1/EVAL_SCALE of a movable piece. Edit by hand or run make tune.
+
+  COPYRIGHT:
+    Copyright 2024 Isaac McCracken - All rights reserved
+*/
+
+#ifndef WEIGHTS_H
+#define WEIGHTS_H
+
+#define EVAL_WEIGHT_MOBILITY 4
+#define EVAL_WEIGHT_CORNERS 8
+#define EVAL_WEIGHT_EDGES 0
+#define EVAL_WEIGHT_PARITY 0
+#define EVAL_WEIGHT_REGIONS 0
+
+#endif